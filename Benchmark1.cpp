@@ -0,0 +1,138 @@
+/*
+//
+// Copyright (c) 1998-2019 Joe Bertolami. All Right Reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, CLUDG, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//   ARE DISCLAIMED.  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//   LIABLE FOR ANY DIRECT, DIRECT, CIDENTAL, SPECIAL, EXEMPLARY, OR
+//   CONSEQUENTIAL DAMAGES (CLUDG, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+//   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSESS TERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER  CONTRACT, STRICT
+//   LIABILITY, OR TORT (CLUDG NEGLIGENCE OR OTHERWISE) ARISG  ANY WAY  OF THE
+//   USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+//
+*/
+
+
+/* Benchmark1.cpp: measures the throughput of the software pixel kernels. */
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "base_pixels.h"
+
+using namespace base;
+using ::std::vector;
+
+/* the resolutions that we benchmark, chosen to span from cache resident to
+   well beyond the last level cache. */
+const uint32 kResolutions[][2] = {
+    {640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+
+/* runs kernel repeatedly for roughly a quarter second and returns GB/s, given
+   the number of bytes that each call reads and writes. */
+template <typename Kernel>
+float64 MeasureThroughput(uint64 bytes_per_call, Kernel kernel) {
+  auto start = ::std::chrono::steady_clock::now();
+  auto elapsed = ::std::chrono::duration<float64>(0);
+  uint64 calls = 0;
+
+  while (elapsed.count() < 0.25) {
+    kernel();
+    calls++;
+    elapsed = ::std::chrono::steady_clock::now() - start;
+  }
+
+  return (float64(bytes_per_call) * calls) / elapsed.count() / 1e9;
+}
+
+int main(int argc, char** argv) {
+  for (auto& resolution : kResolutions) {
+    uint32 width = resolution[0];
+    uint32 height = resolution[1];
+    uint32 count = width * height;
+
+    /* fill our sources with a pattern that exercises every alpha value. */
+    vector<uint32> source(count);
+    vector<uint32> dest(count);
+    vector<uint16> source_565(count);
+    vector<uint16> dest_565(count);
+    for (uint32 i = 0; i < count; i++) {
+      source[i] = i * 2654435761u;
+      source_565[i] = static_cast<uint16>(source[i] >> 7);
+    }
+
+    /* compute reference results with the scalar kernels so that we can flag
+       any instruction set that disagrees with them. */
+    const PixelKernels* scalar = GetPixelKernels(PixelKernelSetScalar);
+    vector<uint32> blend_reference(count, 0xFF808080);
+    vector<uint32> swap_reference(count);
+    vector<uint16> to_565_reference(count);
+    vector<uint32> from_565_reference(count);
+    scalar->blend(blend_reference.data(), source.data(), count);
+    scalar->swap_red_blue(swap_reference.data(), source.data(), count);
+    scalar->to_rgb565(to_565_reference.data(), source.data(), count);
+    scalar->from_rgb565(from_565_reference.data(), source_565.data(), count);
+
+    printf("%ux%u\n", width, height);
+
+    for (uint32 set = 0; set < PixelKernelSetCount; set++) {
+      const PixelKernels* kernels =
+          GetPixelKernels(static_cast<PixelKernelSet>(set));
+      if (!kernels) {
+        continue;
+      }
+
+      bool matches = true;
+      dest.assign(count, 0xFF808080);
+      kernels->blend(dest.data(), source.data(), count);
+      matches = matches && dest == blend_reference;
+      kernels->swap_red_blue(dest.data(), source.data(), count);
+      matches = matches && dest == swap_reference;
+      kernels->to_rgb565(dest_565.data(), source.data(), count);
+      matches = matches && dest_565 == to_565_reference;
+      kernels->from_rgb565(dest.data(), source_565.data(), count);
+      matches = matches && dest == from_565_reference;
+
+      float64 fill = MeasureThroughput(count * 4, [&] {
+        kernels->fill(dest.data(), count, 0xFF204060);
+      });
+      float64 blend = MeasureThroughput(count * 12, [&] {
+        kernels->blend(dest.data(), source.data(), count);
+      });
+      float64 swap = MeasureThroughput(count * 8, [&] {
+        kernels->swap_red_blue(dest.data(), source.data(), count);
+      });
+      float64 to_565 = MeasureThroughput(count * 6, [&] {
+        kernels->to_rgb565(dest_565.data(), source.data(), count);
+      });
+      float64 from_565 = MeasureThroughput(count * 6, [&] {
+        kernels->from_rgb565(dest.data(), source_565.data(), count);
+      });
+
+      printf(
+          "  %-8s fill %7.2f GB/s  blend %7.2f GB/s  swap %7.2f GB/s  "
+          "to565 %7.2f GB/s  from565 %7.2f GB/s%s\n",
+          kernels->name, fill, blend, swap, to_565, from_565,
+          matches ? "" : "  (MISMATCH)");
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+/*
+//
+// Copyright (c) 1998-2019 Joe Bertolami. All Right Reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, CLUDG, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//   ARE DISCLAIMED.  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//   LIABLE FOR ANY DIRECT, DIRECT, CIDENTAL, SPECIAL, EXEMPLARY, OR
+//   CONSEQUENTIAL DAMAGES (CLUDG, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+//   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSESS TERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER  CONTRACT, STRICT
+//   LIABILITY, OR TORT (CLUDG NEGLIGENCE OR OTHERWISE) ARISG  ANY WAY  OF THE
+//   USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+//
+*/
+
+
+/* Benchmark2.cpp: measures how the tiled software rasterizer scales with the
+   number of worker threads. */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+#include "base_raster.h"
+
+using namespace base;
+using ::std::vector;
+
+const uint32 kTargetWidth = 1920;
+const uint32 kTargetHeight = 1080;
+const uint32 kTriangleCount = 50000;
+const uint32 kRectCount = 5000;
+const uint32 kLineCount = 5000;
+const uint32 kSpriteCount = 5000;
+
+/* records a deterministic scene of mixed primitives. */
+void DrawScene(Rasterizer* rasterizer, const PixelBuffer& texture) {
+  ::std::mt19937 random(1234);
+  ::std::uniform_real_distribution<float32> x(0, kTargetWidth);
+  ::std::uniform_real_distribution<float32> y(0, kTargetHeight);
+  ::std::uniform_real_distribution<float32> offset(-32, 32);
+
+  rasterizer->Clear(MakePixel(32, 32, 48));
+
+  for (uint32 i = 0; i < kTriangleCount; i++) {
+    float32 cx = x(random), cy = y(random);
+    rasterizer->DrawTriangle(cx + offset(random), cy + offset(random),
+                             cx + offset(random), cy + offset(random),
+                             cx + offset(random), cy + offset(random),
+                             random() | 0x80000000);
+  }
+
+  for (uint32 i = 0; i < kRectCount; i++) {
+    rasterizer->DrawRect(x(random), y(random), 48, 24, random() | 0xFF000000);
+  }
+
+  for (uint32 i = 0; i < kLineCount; i++) {
+    rasterizer->DrawLine(x(random), y(random), x(random), y(random),
+                         random() | 0xFF000000);
+  }
+
+  for (uint32 i = 0; i < kSpriteCount; i++) {
+    rasterizer->DrawTexturedQuad(x(random), y(random), 32, 32, texture);
+  }
+}
+
+/* returns an FNV-1a hash of the visible pixels in buffer. */
+uint64 HashPixels(const PixelBuffer& buffer) {
+  uint64 hash = 14695981039346656037ull;
+  for (uint32 row = 0; row < buffer.height; row++) {
+    for (uint32 column = 0; column < buffer.width; column++) {
+      hash = (hash ^ buffer.pixels[row * buffer.stride + column]) *
+             1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+int main(int argc, char** argv) {
+  vector<uint32> target_pixels(kTargetWidth * kTargetHeight);
+  PixelBuffer target = {target_pixels.data(), kTargetWidth, kTargetHeight,
+                        kTargetWidth};
+
+  /* a translucent checkerboard sprite exercises the blended texture path. */
+  vector<uint32> texture_pixels(64 * 64);
+  for (uint32 i = 0; i < texture_pixels.size(); i++) {
+    bool is_dark = ((i % 64) / 8 + (i / 64) / 8) & 1;
+    texture_pixels[i] =
+        is_dark ? MakePixel(0, 0, 0, 128) : MakePixel(255, 200, 0);
+  }
+  PixelBuffer texture = {texture_pixels.data(), 64, 64, 64};
+
+  /* by default we scale up to one thread per hardware thread, but a different
+     limit may be supplied on the command line. */
+  uint32 max_threads = ::std::thread::hardware_concurrency();
+  if (argc > 1) {
+    max_threads = static_cast<uint32>(atoi(argv[1]));
+  }
+  max_threads = max_threads ? max_threads : 1;
+  float64 single_thread_ms = 0;
+
+  for (uint32 threads = 1; threads <= max_threads;
+       threads = (threads == max_threads) ? threads + 1
+                                          : ::std::min(threads * 2, max_threads)) {
+    Rasterizer rasterizer(threads);
+    uint32 frames = 0;
+    ::std::chrono::duration<float64> elapsed(0);
+
+    /* we time the full frame, including recording and binning. */
+    while (elapsed.count() < 1.0 || frames < 3) {
+      auto start = ::std::chrono::steady_clock::now();
+      rasterizer.Begin(target);
+      DrawScene(&rasterizer, texture);
+      rasterizer.End();
+      elapsed += ::std::chrono::steady_clock::now() - start;
+      frames++;
+    }
+
+    float64 frame_ms = elapsed.count() * 1000.0 / frames;
+    single_thread_ms = (threads == 1) ? frame_ms : single_thread_ms;
+    const RasterStats& stats = rasterizer.GetStats();
+
+    /* the hash must be identical for every thread count. */
+    printf(
+        "%3u threads: %8.2f ms/frame  speedup %5.2fx  tiles %u  binned %u  "
+        "steals %u  hash %016llx\n",
+        threads, frame_ms, single_thread_ms / frame_ms, stats.tiles,
+        stats.binned_commands, stats.steals,
+        static_cast<unsigned long long>(HashPixels(target)));
+  }
+
+  return 0;
+}
@@ -0,0 +1,181 @@
+/*
+//
+// Copyright (c) 1998-2019 Joe Bertolami. All Right Reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, CLUDG, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//   ARE DISCLAIMED.  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//   LIABLE FOR ANY DIRECT, DIRECT, CIDENTAL, SPECIAL, EXEMPLARY, OR
+//   CONSEQUENTIAL DAMAGES (CLUDG, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+//   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSESS TERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER  CONTRACT, STRICT
+//   LIABILITY, OR TORT (CLUDG NEGLIGENCE OR OTHERWISE) ARISG  ANY WAY  OF THE
+//   USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+//
+*/
+
+
+
+/* Benchmark3.cpp: streams a window's framebuffer to a local viewer and reports
+   throughput and bytes per frame for a few kinds of content. */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include "base_pixels.h"
+#include "base_stream.h"
+
+using namespace base;
+using ::std::vector;
+
+const uint32 kFrameWidth = 1280;
+const uint32 kFrameHeight = 720;
+const char kPipeName[] = "base_window_benchmark3";
+
+/* each scenario draws frame index into buffer. */
+typedef void (*DrawFunction)(const PixelBuffer& buffer, uint32 frame);
+
+/* nothing changes after the first frame. */
+void DrawStatic(const PixelBuffer& buffer, uint32 frame) {
+  ClearPixels(buffer, MakePixel(32, 32, 48));
+}
+
+/* a small sprite moves over a flat background, like a cursor or a character. */
+void DrawSprite(const PixelBuffer& buffer, uint32 frame) {
+  ClearPixels(buffer, MakePixel(32, 32, 48));
+  int32 x = (frame * 7) % (kFrameWidth - 48);
+  int32 y = (frame * 3) % (kFrameHeight - 48);
+  FillRect(buffer, x, y, 48, 48, MakePixel(255, 200, 0));
+}
+
+/* a scrolling band of gradients, which changes every tile each frame. */
+void DrawScroll(const PixelBuffer& buffer, uint32 frame) {
+  for (uint32 y = 0; y < buffer.height; y++) {
+    uint32 band = ((y + frame * 4) / 16) & 0xFF;
+    FillRect(buffer, 0, y, buffer.width, 1, MakePixel(band, 255 - band, 96));
+  }
+}
+
+/* random noise is the worst case for the encoder. */
+void DrawNoise(const PixelBuffer& buffer, uint32 frame) {
+  ::std::mt19937 random(frame);
+  for (uint32 y = 0; y < buffer.height; y++) {
+    for (uint32 x = 0; x < buffer.width; x++) {
+      buffer.pixels[y * buffer.stride + x] = random() | 0xFF000000;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  BaseWindow window("Benchmark3", 0, 0, kFrameWidth, kFrameHeight,
+                    BASE_WINDOW_STYLE_WINDOW_HIDDEN);
+  ::std::unique_ptr<FramebufferServer> server(
+      new FramebufferServer(&window, kPipeName));
+  if (!window.IsValid() || !server->IsValid()) {
+    printf("Failed to create the window or pipe.\n");
+    return 1;
+  }
+
+  /* the viewer runs on its own thread, acknowledging every tenth frame with
+     a mouse move so that the input path is exercised too. */
+  ::std::atomic<bool> viewer_ready(false);
+  ::std::atomic<bool> viewer_failed(false);
+  ::std::thread viewer([&viewer_ready, &viewer_failed]() {
+    FramebufferClient client;
+    if (!client.Connect(kPipeName, 5000)) {
+      viewer_failed = true;
+      return;
+    }
+    viewer_ready = true;
+    while (client.ReceiveFrame()) {
+      if (client.GetStats().frames_sent % 10 == 0) {
+        InputEvent event = {InputTypeTarget, kInputMouseMoveIndex, 0,
+                            1.0f, 2.0f, false};
+        client.SendInput(event);
+      }
+    }
+  });
+
+  while (!viewer_ready || !server->IsConnected()) {
+    if (viewer_failed) {
+      printf("The viewer failed to connect.\n");
+      viewer.join();
+      return 1;
+    }
+    server->Publish();
+    ::std::this_thread::yield();
+  }
+
+  const struct {
+    const char* name;
+    DrawFunction draw;
+  } kScenarios[] = {{"static", DrawStatic},
+                    {"sprite", DrawSprite},
+                    {"scroll", DrawScroll},
+                    {"noise", DrawNoise}};
+
+  vector<InputEvent> events;
+  uint64 raw_frame_bytes = uint64(kFrameWidth) * kFrameHeight * 4;
+
+  for (const auto& scenario : kScenarios) {
+    StreamStats before = server->GetStats();
+    uint64 input_events = 0;
+    uint32 frame = 0;
+    auto start = ::std::chrono::steady_clock::now();
+    ::std::chrono::duration<float64> elapsed(0);
+
+    while (elapsed.count() < 2.0) {
+      scenario.draw(window.GetPixelBuffer(), frame++);
+      server->Publish();
+      window.Update(&events);
+      for (const InputEvent& event : events) {
+        input_events += (event.switch_index == kInputMouseMoveIndex);
+      }
+      elapsed = ::std::chrono::steady_clock::now() - start;
+    }
+
+    const StreamStats& after = server->GetStats();
+    uint64 sent = after.frames_sent - before.frames_sent;
+    uint64 bytes = after.bytes_sent - before.bytes_sent;
+    uint64 tiles = after.tiles_sent - before.tiles_sent;
+    uint64 raw = after.raw_bytes - before.raw_bytes;
+    sent = sent ? sent : 1;
+
+    /* bytes per frame is compared against sending the whole frame raw. */
+    printf(
+        "%-8s %7.1f frames/s  %8.1f MB/s  %9.0f bytes/frame (%6.2f%% of raw)  "
+        "%6.1f tiles/frame  ratio %5.2fx  dropped %llu  input %llu\n",
+        scenario.name, sent / elapsed.count(),
+        bytes / elapsed.count() / (1024.0 * 1024.0), float64(bytes) / sent,
+        100.0 * bytes / (sent * raw_frame_bytes), float64(tiles) / sent,
+        bytes ? float64(raw) / bytes : 0.0,
+        static_cast<unsigned long long>(after.frames_dropped -
+                                        before.frames_dropped),
+        static_cast<unsigned long long>(input_events));
+  }
+
+  /* closing the pipe ends the viewer's receive loop. */
+  server.reset();
+  viewer.join();
+
+  return 0;
+}
@@ -57,7 +57,7 @@ int main(int argc, char** argv) {
     /* Handle all of our recent events that collected in our queue. */
     for (auto& event : window_events) {
       /* If the user pressed escape, exit the app. */
-      if (event.switch_index == 27) {
+      if (event.switch_index == kInputKeyEscapeIndex) {
         return 0;
       }
       /* Check if the left mouse was clicked and report its values if so.
@@ -32,6 +32,17 @@
 #ifndef __BASE_GRAPHICS_H__
 #define __BASE_GRAPHICS_H__
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "base_window.h"
 
 #if defined(BASE_PLATFORM_WINDOWS)
@@ -40,8 +51,318 @@
 #include "OpenGL/gl.h"
 #endif
 
+// The OpenGL headers that ship with Windows only expose version 1.1 of the
+// API. Anything newer must be fetched from the driver at runtime, so we declare
+// the handful of types and tokens that we rely upon here.
+#ifndef GL_VERSION_3_2
+typedef struct __GLsync* GLsync;
+typedef uint64_t GLuint64;
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_CONDITION_SATISFIED 0x911C
+#define GL_WAIT_FAILED 0x911D
+#define GL_TIMEOUT_IGNORED 0xFFFFFFFFFFFFFFFFull
+#endif
+
+#ifndef GL_VERSION_1_5
+typedef ptrdiff_t GLsizeiptr;
+typedef ptrdiff_t GLintptr;
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+
+#ifndef GL_COPY_READ_BUFFER
+#define GL_COPY_READ_BUFFER 0x8F36
+#define GL_COPY_WRITE_BUFFER 0x8F37
+#endif
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT 0x0004
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
 namespace base {
 
+// The maximum number of frames that may be queued ahead of the display when
+// frame latency control is enabled.
+const uint32 kMaxFramesInFlight = 8;
+
+// The number of frames the main thread may record ahead of the render thread
+// when threaded rendering is enabled.
+const uint32 kRenderThreadFrameCount = 2;
+
+// The default size of the streaming upload ring, and the number of fenced
+// segments that it is divided into. A single upload may not exceed the size
+// of a segment, so the ring grows as needed to accommodate larger uploads.
+const uint32 kDefaultStreamingUploadSize = 16 * 1024 * 1024;
+const uint32 kStreamingUploadSegmentCount = 4;
+// The largest segment the ring will grow to. This keeps the size of the ring,
+// and every offset within it, well inside 32 bits.
+const uint32 kMaxStreamingUploadSegmentSize =
+    0x80000000u / kStreamingUploadSegmentCount;
+// While rendering is throttled, BeginScene waits this long for window messages
+// before rechecking visibility.
+const uint32 kThrottledPollMilliseconds = 100;
+
+// Blend states supported by the 2D batcher.
+enum BlendMode : uint8 {
+  BlendModeOpaque,
+  BlendModeAlpha,
+  BlendModeAdditive,
+};
+
+typedef struct BatchStats {
+  // The number of draw calls issued to render the batch.
+  uint32 draw_calls;
+  // The number of primitives (quads, lines, and points) in the batch.
+  uint32 primitives;
+  // The number of vertices streamed to the GPU for the batch.
+  uint32 vertices;
+} BatchStats;
+
+// Entry points that are not exported by the system OpenGL library and must be
+// loaded from the driver once a context is current. Any of these may be null
+// if the driver does not support the associated version or extension.
+typedef struct GraphicsExtensions {
+  // WGL_EXT_swap_control.
+  int(APIENTRY* swap_interval)(int interval);
+  // OpenGL 3.2 or ARB_sync.
+  GLsync(APIENTRY* fence_sync)(GLenum condition, GLbitfield flags);
+  GLenum(APIENTRY* client_wait_sync)(GLsync sync, GLbitfield flags,
+                                     GLuint64 timeout);
+  void(APIENTRY* delete_sync)(GLsync sync);
+  void(APIENTRY* wait_sync)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+  // OpenGL 1.5.
+  void(APIENTRY* gen_buffers)(GLsizei count, GLuint* buffers);
+  void(APIENTRY* delete_buffers)(GLsizei count, const GLuint* buffers);
+  void(APIENTRY* bind_buffer)(GLenum target, GLuint buffer);
+  void(APIENTRY* buffer_data)(GLenum target, GLsizeiptr size, const void* data,
+                              GLenum usage);
+  void(APIENTRY* buffer_sub_data)(GLenum target, GLintptr offset,
+                                  GLsizeiptr size, const void* data);
+  GLboolean(APIENTRY* unmap_buffer)(GLenum target);
+  // OpenGL 3.0 or ARB_map_buffer_range.
+  void*(APIENTRY* map_buffer_range)(GLenum target, GLintptr offset,
+                                    GLsizeiptr length, GLbitfield access);
+  // OpenGL 3.1 or ARB_copy_buffer.
+  void(APIENTRY* copy_buffer_sub_data)(GLenum read_target, GLenum write_target,
+                                       GLintptr read_offset,
+                                       GLintptr write_offset, GLsizeiptr size);
+  // OpenGL 4.4 or ARB_buffer_storage.
+  void(APIENTRY* buffer_storage)(GLenum target, GLsizeiptr size,
+                                 const void* data, GLbitfield flags);
+#if defined(BASE_PLATFORM_WINDOWS)
+  // WGL_ARB_create_context.
+  HGLRC(APIENTRY* create_context_attribs)(HDC device_context,
+                                          HGLRC share_context,
+                                          const int* attributes);
+#endif
+  // Set to true if the driver supports negative (adaptive) swap intervals.
+  bool supports_adaptive_vsync;
+} GraphicsExtensions;
+
+// A graphics context that shares textures, buffers, and other objects with the
+// window that created it. Shared contexts let loader threads upload resources
+// without stalling the thread that renders the window. Shared contexts must be
+// destroyed before the window that created them.
+class SharedGraphicsContext;
+
+// A ring of driver visible staging memory used to stream dynamic content, such
+// as video frames, to the GPU. The CPU writes directly into the ring and the
+// copy into the destination texture or buffer is performed by the GPU, so that
+// uploads overlap with rendering rather than synchronizing with it.
+//
+// We prefer a persistently mapped ring (ARB_buffer_storage), fenced in
+// segments so that the CPU never overwrites data the GPU has yet to consume.
+// Older drivers fall back to orphaning the ring each time it wraps, and
+// drivers that cannot copy between buffer objects (OpenGL 3.1 or
+// ARB_copy_buffer) fall back to uploading from client memory.
+class StreamingUploadBuffer {
+ public:
+  explicit StreamingUploadBuffer(const GraphicsExtensions* extensions);
+  StreamingUploadBuffer(const StreamingUploadBuffer& rhs) = delete;
+  ~StreamingUploadBuffer();
+
+  // Reserves size bytes of staging memory and returns a pointer for the CPU to
+  // write into, or null on failure (including sizes above
+  // kMaxStreamingUploadSegmentSize). Each call must be followed by exactly one
+  // call to StreamTexture or StreamBuffer, which consumes the reservation.
+  void* Map(uint32 size);
+  // Copies the most recent reservation into a region of texture, which is left
+  // bound to GL_TEXTURE_2D. Returns false if there was no reservation.
+  bool StreamTexture(GLuint texture, int32 x, int32 y, uint32 width,
+                     uint32 height, GLenum format, GLenum type);
+  // Copies the most recent reservation into buffer at the supplied offset.
+  // Returns false if there was no reservation, or if the driver does not
+  // support buffer objects, in which case the data is discarded.
+  bool StreamBuffer(GLuint buffer, uint32 offset);
+
+ private:
+  enum StreamingMode : uint8 {
+    StreamingModeClient,
+    StreamingModeOrphan,
+    StreamingModePersistent,
+  };
+
+  // (Re)creates the ring with room for segments of at least segment_size.
+  // Returns false, leaving the current ring intact, if segment_size exceeds
+  // kMaxStreamingUploadSegmentSize.
+  bool CreateRing(uint32 segment_size);
+  // Releases the ring along with any outstanding segment fences.
+  void DestroyRing();
+  // Finalizes the current reservation prior to it being read by the GPU.
+  void Unmap();
+  // Fences the segment the write head is leaving and waits for the segment it
+  // is entering to be released by the GPU.
+  void AdvanceSegment();
+
+  const GraphicsExtensions* extensions_;
+  StreamingMode mode_;
+  // The name of the buffer object that backs the ring, if any.
+  GLuint ring_buffer_;
+  // The persistent mapping for the ring, or client memory in client mode.
+  uint8* ring_memory_;
+  ::std::vector<uint8> client_memory_;
+  uint32 ring_size_;
+  uint32 segment_size_;
+  // The write head, and the segment that contains it.
+  uint32 head_;
+  uint32 head_segment_;
+  // The offset and size of the current reservation.
+  uint32 staged_offset_;
+  uint32 staged_size_;
+  bool is_mapped_;
+  // Fences that guard each segment against reuse while the GPU reads from it.
+  GLsync segment_fences_[kStreamingUploadSegmentCount];
+};
+
+// Accumulates 2D quads, lines, and points into a single vertex stream and
+// renders them with as few draw calls as possible. Primitives are sorted by
+// layer, then by blend mode and texture, and submission order is preserved
+// only within primitives that share all three. Thus primitives that must be
+// drawn in a specific order should be placed on increasing layers.
+//
+// Coordinates are in pixels, with the origin at the upper left corner of the
+// window. Colors are packed RGBA with red in the low byte.
+class Batch2D {
+ public:
+  Batch2D();
+  Batch2D(const Batch2D& rhs) = delete;
+
+  // Queues an axis aligned quad. If texture is non-zero, the quad is mapped
+  // with the texture coordinate range (u0, v0) to (u1, v1).
+  void AddQuad(float32 x, float32 y, float32 width, float32 height,
+               uint32 color, GLuint texture, float32 u0, float32 v0,
+               float32 u1, float32 v1, BlendMode blend, uint16 layer);
+  // Queues a single pixel wide line.
+  void AddLine(float32 x0, float32 y0, float32 x1, float32 y1, uint32 color,
+               BlendMode blend, uint16 layer);
+  // Queues a single pixel.
+  void AddPoint(float32 x, float32 y, uint32 color, BlendMode blend,
+                uint16 layer);
+  // Sorts the queued primitives into draw calls. This performs all of the CPU
+  // work of the batch, and may be called from any thread.
+  void Prepare(uint32 width, uint32 height);
+  // Issues the draw calls for a prepared batch and resets it for reuse.
+  // Requires a current context.
+  void Draw();
+  // Discards the queued primitives without drawing them.
+  void Clear();
+  // Returns statistics for the most recently prepared batch.
+  const BatchStats& GetStats() const;
+
+ private:
+  enum BatchPrimitiveType : uint8 {
+    BatchPrimitiveQuad,
+    BatchPrimitiveLine,
+    BatchPrimitivePoint,
+  };
+
+  typedef struct BatchVertex {
+    float32 x, y;
+    float32 u, v;
+    uint32 color;
+  } BatchVertex;
+
+  typedef struct BatchPrimitive {
+    // Sort key composed of layer, blend mode, primitive type, and texture.
+    uint64 key;
+    uint32 first_vertex;
+  } BatchPrimitive;
+
+  typedef struct BatchRun {
+    uint64 key;
+    uint32 first_index;
+    uint32 index_count;
+  } BatchRun;
+
+  static uint64 MakeKey(uint16 layer, BlendMode blend, BatchPrimitiveType type,
+                        GLuint texture);
+  void AddVertex(float32 x, float32 y, float32 u, float32 v, uint32 color);
+
+  // Storage is cleared, not released, after each frame so that steady state
+  // batching does not allocate.
+  ::std::vector<BatchVertex> vertices_;
+  ::std::vector<BatchPrimitive> primitives_;
+  ::std::vector<uint32> indices_;
+  ::std::vector<BatchRun> runs_;
+  uint32 width_;
+  uint32 height_;
+  BatchStats stats_;
+};
+
+class SharedGraphicsContext {
+ public:
+  SharedGraphicsContext(const SharedGraphicsContext& rhs) = delete;
+  ~SharedGraphicsContext();
+
+  // Binds the context to the calling thread. A context may only be current on
+  // a single thread at a time. Returns true on success.
+  bool MakeCurrent();
+  // Unbinds the context from the calling thread.
+  void Release();
+  // Inserts a fence behind every command issued so far on this context and
+  // flushes them to the GPU. Hand the fence to GraphicsWindow::WaitForFence
+  // before rendering with any resources written prior to the fence. Returns
+  // null if fences are unsupported, in which case the commands are finished
+  // before returning.
+  GLsync InsertFence();
+
+ private:
+  friend class GraphicsWindow;
+#if defined(BASE_PLATFORM_WINDOWS)
+  SharedGraphicsContext(HDC device_context_handle, HGLRC graphics_handle,
+                        const GraphicsExtensions* extensions);
+
+  HDC device_context_handle_;
+  HGLRC graphics_handle_;
+#endif
+  // Owned by the parent window. Both contexts share a pixel format, so entry
+  // points loaded for the window are valid here as well.
+  const GraphicsExtensions* extensions_;
+};
+
 class GraphicsWindow : public BaseWindow {
  public:
   GraphicsWindow(const ::std::string& title, uint32 x, uint32 y, uint32 width, uint32 height,
@@ -49,25 +370,189 @@ class GraphicsWindow : public BaseWindow {
   GraphicsWindow(const GraphicsWindow& rhs) = delete;
   ~GraphicsWindow();
 
-  // Acquires the graphics context for the current frame.
-  void BeginScene();
+  // Acquires the graphics context for the current frame. Returns false if
+  // the frame should be skipped because rendering is throttled (see
+  // SetRenderThrottle), in which case nothing should be drawn. EndScene may
+  // still be called for a skipped frame, and does nothing.
+  bool BeginScene();
   // Releases the graphics context for the current frame.
   void EndScene();
+  // Enables or disables render throttling. While enabled and the window is
+  // not visible, BeginScene skips frames, rendering at most hidden_frame_rate
+  // frames per second (none if zero). Skipped frames wait for window messages
+  // rather than returning immediately, so that the app's loop stays idle.
+  void SetRenderThrottle(bool enabled, float32 hidden_frame_rate = 0);
   // Careful with this call -- we're double buffering so this should never
   // be used (swap will implicitly force a pipeline stall), except in the
   // circumstance of multi-threaded resource rendering.
   void Resolve();
+  // Sets the number of vertical blanks to wait for between buffer swaps. An
+  // interval of zero disables vsync, and -1 requests adaptive vsync (swap
+  // immediately if the frame is late) where supported. Returns true if the
+  // driver accepted the interval. While the render thread is running, this
+  // blocks until the render thread has applied the interval.
+  bool SetSwapInterval(int32 interval);
+  // Limits the number of frames the driver may queue ahead of the display.
+  // Lower values reduce input-to-photon latency at the cost of throughput. A
+  // value of zero leaves frame queueing up to the driver.
+  void SetMaxFramesInFlight(uint32 frame_count);
+  // Moves the graphics context onto a dedicated render thread. While the
+  // render thread is running, BeginScene and EndScene no longer issue OpenGL
+  // calls on the calling thread. Instead, rendering work for the frame is
+  // recorded with Submit and executed by the render thread, so that the next
+  // frame's Update and app logic overlap with the rendering of this one.
+  // Returns false if the render thread could not be started.
+  bool StartRenderThread();
+  // Drains all submitted frames, stops the render thread, and returns the
+  // graphics context to the calling thread. StartRenderThread and
+  // StopRenderThread must not be called concurrently with each other.
+  void StopRenderThread();
+  // Records a command to run on the render thread. Commands submitted between
+  // BeginScene and EndScene, by the thread that called BeginScene, become part
+  // of the current frame. Commands submitted at any other time, or from any
+  // other thread, are run by the render thread before its next frame. If the
+  // render thread is not running, the command is executed immediately.
+  void Submit(::std::function<void()> command);
+  // Creates a context that shares objects with this window, for use on a
+  // loader thread. Returns null if the context could not be created.
+  ::std::unique_ptr<SharedGraphicsContext> CreateSharedContext();
+  // Makes subsequent rendering on this window wait for the supplied fence, as
+  // returned by SharedGraphicsContext::InsertFence, and releases the fence.
+  // The wait occurs on the GPU and does not block the calling thread.
+  void WaitForFence(GLsync fence);
+  // Returns size bytes of driver visible staging memory for the CPU to write
+  // dynamic content into, or null on failure. Follow each call with exactly
+  // one call to StreamTexture or StreamBuffer. These must be called from the
+  // thread that owns the context, i.e. from within Submit when the render
+  // thread is running.
+  void* MapStreamingUpload(uint32 size);
+  // Uploads the staged data into a region of texture. Returns false if no
+  // data was staged.
+  bool StreamTexture(GLuint texture, int32 x, int32 y, uint32 width,
+                     uint32 height, GLenum format, GLenum type);
+  // Uploads the staged data into buffer at the supplied byte offset. Returns
+  // false if no data was staged or the upload is unsupported by the driver.
+  bool StreamBuffer(GLuint buffer, uint32 offset);
+  // Queues a quad, line, or point with the built-in 2D batcher. Batched
+  // primitives are rendered in EndScene after any other commands for the
+  // frame. Primitives queued outside of a frame are rendered with the next
+  // one. These must be called from the thread that calls BeginScene. See
+  // Batch2D for the coordinate and color conventions.
+  void DrawQuad(float32 x, float32 y, float32 width, float32 height,
+                uint32 color, BlendMode blend = BlendModeAlpha);
+  void DrawQuad(float32 x, float32 y, float32 width, float32 height,
+                uint32 color, GLuint texture, float32 u0 = 0, float32 v0 = 0,
+                float32 u1 = 1, float32 v1 = 1,
+                BlendMode blend = BlendModeAlpha);
+  void DrawLine(float32 x0, float32 y0, float32 x1, float32 y1, uint32 color,
+                BlendMode blend = BlendModeAlpha);
+  void DrawPoint(float32 x, float32 y, uint32 color,
+                 BlendMode blend = BlendModeAlpha);
+  // Sets the layer for subsequently queued primitives. Layers are drawn in
+  // increasing order.
+  void SetBatchLayer(uint16 layer);
+  // Returns the batcher statistics for the most recently ended frame.
+  const BatchStats& GetBatchStats() const;
 
  private:
   // Creates and initializes the graphical subsystem of the window.
   void CreateGraphics(uint32 render_bpp, uint32 depth_stencil_bpp);
+#if defined(BASE_PLATFORM_WINDOWS)
+  // Selects and applies a pixel format for the window's device context.
+  // Formats are chosen once per combination of bit depths and shared by all
+  // later windows, as ChoosePixelFormat is slow.
+  bool ApplyPixelFormat(const PIXELFORMATDESCRIPTOR& pfd);
+#endif
   // Tears down the graphics subsystem of the window and releases any connected
   // operating system resources.
   void DestroyGraphics();
+  // Loads any entry points beyond OpenGL 1.1. Requires a current context.
+  void LoadExtensions();
+  // Fences the frame that was just submitted and blocks until no more than
+  // max_frames_in_flight_ frames are outstanding on the GPU.
+  void ThrottleFrames();
+  // Waits on and releases every outstanding frame fence.
+  void DrainFrameFences();
+  // Sets the default render state at the start of each frame.
+  void ApplySceneState();
+  // Presents the back buffer and applies frame latency control.
+  void PresentScene();
+  // The entry point of the render thread.
+  void RenderThreadMain();
+  // Blocks until the render thread has released the frame slot at
+  // submitted_frames_, so that the caller may record into it. This only blocks
+  // if we've run a full ring ahead of the render thread.
+  void AcquireFrameSlot();
+  // Queues a command for the render thread to run before its next frame, and
+  // wakes the render thread. May be called from any thread.
+  void PostRenderCommand(::std::function<void()> command);
+  // Runs every command queued by PostRenderCommand.
+  void RunRenderCommands();
+  // Returns the batch that belongs to the frame currently being recorded.
+  Batch2D& GetCurrentBatch();
+  // Returns true if the render thread is running and the caller is not the
+  // render thread, in which case OpenGL work must be deferred through Submit.
+  bool ShouldDeferToRenderThread() const;
+
+  // Driver entry points loaded by LoadExtensions.
+  GraphicsExtensions extensions_;
+  // The maximum number of frames that may be outstanding, or zero if the
+  // driver is free to decide.
+  uint32 max_frames_in_flight_;
+  // A running count of frames submitted through EndScene.
+  uint64 frame_count_;
+  // Fences for each frame that is currently outstanding on the GPU.
+  GLsync frame_fences_[kMaxFramesInFlight];
+  // Created on first use by MapStreamingUpload.
+  ::std::unique_ptr<StreamingUploadBuffer> streaming_upload_;
+
+  // The render thread and its command buffer. Frames form a single producer,
+  // single consumer ring: the main thread owns the slot at submitted_frames_
+  // until it publishes it in EndScene, and the render thread owns the slot at
+  // completed_frames_ until it has been executed.
+  ::std::thread render_thread_;
+  // The id of the render thread while it is running. Any thread may test
+  // this, whereas render_thread_ is only touched by StartRenderThread and
+  // StopRenderThread.
+  ::std::atomic<::std::thread::id> render_thread_id_;
+  ::std::vector<::std::function<void()>> render_frames_[kRenderThreadFrameCount];
+  ::std::atomic<uint64> submitted_frames_;
+  ::std::atomic<uint64> completed_frames_;
+  ::std::atomic<bool> render_thread_stopping_;
+  // The thread recording the current frame, set from BeginScene to EndScene.
+  ::std::atomic<::std::thread::id> recording_thread_;
+  // Commands submitted outside of a frame. Any thread may queue them, so they
+  // are guarded by a mutex, and the render thread swaps them into
+  // running_commands_ before running them.
+  ::std::mutex render_commands_mutex_;
+  ::std::vector<::std::function<void()>> render_commands_;
+  ::std::vector<::std::function<void()>> running_commands_;
+
+  // One batch per render thread frame slot, so that the main thread can fill
+  // the next batch while the render thread draws the previous one.
+  Batch2D batches_[kRenderThreadFrameCount];
+  uint16 batch_layer_;
+  BatchStats batch_stats_;
+
+  // The size last applied to the viewport. The viewport follows the window
+  // size at the start of each frame.
+  uint32 viewport_width_;
+  uint32 viewport_height_;
+
+  // Render throttling state. The interval is zero if hidden windows should
+  // not render at all.
+  bool is_throttle_enabled_;
+  float64 hidden_frame_interval_;
+  bool is_scene_skipped_;
+  ::std::chrono::steady_clock::time_point last_hidden_frame_time_;
 
 #if defined(BASE_PLATFORM_WINDOWS)
   HDC device_context_handle_;
   HGLRC graphics_handle_;
+  // Wake-up signals for the render thread command buffer. The ring itself is
+  // lock free; these only let idle threads sleep instead of spin.
+  HANDLE frame_submitted_event_;
+  HANDLE frame_completed_event_;
 #elif defined(BASE_PLATFORM_IOS)
   // iOS does not provide a default framebuffer. We create one to use
   // whenever no other framebuffer is set. This default framebuffer uses
@@ -86,20 +571,62 @@ namespace base {
 
 #if defined(BASE_PLATFORM_WINDOWS)
 #pragma comment(lib, "OpenGL32.lib")
+
+// Loads a driver entry point into the supplied function pointer. Some drivers
+// return small sentinel values rather than null for unsupported entry points,
+// so we treat these as failures as well.
+template <typename T>
+void LoadEntryPoint(T* entry_point, const char* name) {
+  PROC address = wglGetProcAddress(name);
+  intptr_t value = reinterpret_cast<intptr_t>(address);
+
+  if (value == 0 || value == 1 || value == 2 || value == 3 || value == -1) {
+    address = nullptr;
+  }
+
+  *entry_point = reinterpret_cast<T>(address);
+}
 #endif
 
 GraphicsWindow::GraphicsWindow(const ::std::string& title, uint32 x, uint32 y, uint32 width,
                                uint32 height, uint32 render_bpp, uint32 depth_stencil_bpp,
-                               uint32 style_flags) {
+                               uint32 style_flags)
+    : extensions_(),
+      max_frames_in_flight_(0),
+      frame_count_(0),
+      frame_fences_(),
+      submitted_frames_(0),
+      completed_frames_(0),
+      render_thread_stopping_(false),
+      render_thread_id_(::std::thread::id()),
+      recording_thread_(::std::thread::id()),
+      batch_layer_(0),
+      batch_stats_(),
+      viewport_width_(0),
+      viewport_height_(0),
+      is_throttle_enabled_(false),
+      hidden_frame_interval_(0),
+      is_scene_skipped_(false) {
   Create(title, x, y, width, height, style_flags);
+
+  auto start_time = ::std::chrono::steady_clock::now();
   CreateGraphics(render_bpp, depth_stencil_bpp);
+  creation_stats_.graphics_seconds =
+      ::std::chrono::duration<float64>(::std::chrono::steady_clock::now() -
+                                       start_time)
+          .count();
 }
 
-GraphicsWindow::~GraphicsWindow() { DestroyGraphics(); }
+GraphicsWindow::~GraphicsWindow() {
+  StopRenderThread();
+  DestroyGraphics();
+}
 
 void GraphicsWindow::CreateGraphics(uint32 render_bpp, uint32 depth_stencil_bpp) {
 #if defined(BASE_PLATFORM_WINDOWS)
   PIXELFORMATDESCRIPTOR pfd;
+  frame_submitted_event_ = NULL;
+  frame_completed_event_ = NULL;
   device_context_handle_ = (HDC)GetDC(window_handle_);
 
   memset(&pfd, 0, sizeof(pfd));
@@ -112,14 +639,18 @@ void GraphicsWindow::CreateGraphics(uint32 render_bpp, uint32 depth_stencil_bpp)
   pfd.cDepthBits = depth_stencil_bpp;
   pfd.iLayerType = PFD_MAIN_PLANE;
 
-  SetPixelFormat(device_context_handle_, ChoosePixelFormat(device_context_handle_, &pfd), &pfd);
+  ApplyPixelFormat(pfd);
 
   graphics_handle_ = wglCreateContext(device_context_handle_);
   wglMakeCurrent(device_context_handle_, graphics_handle_);
 #endif
 
+  LoadExtensions();
+
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
   glViewport(0, 0, width_, height_);
+  viewport_width_ = width_;
+  viewport_height_ = height_;
   glPointSize(45.0);
 
   glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
@@ -128,7 +659,111 @@ void GraphicsWindow::CreateGraphics(uint32 render_bpp, uint32 depth_stencil_bpp)
   glHint(GL_POLYGON_SMOOTH_HINT, GL_NICEST);
 }
 
+#if defined(BASE_PLATFORM_WINDOWS)
+// A pixel format index chosen for a combination of bit depths.
+typedef struct PixelFormatCacheEntry {
+  uint32 color_bits;
+  uint32 depth_bits;
+  int32 format;
+} PixelFormatCacheEntry;
+
+// Pixel formats chosen so far in this process, guarded by mutex.
+typedef struct PixelFormatCache {
+  ::std::mutex mutex;
+  ::std::vector<PixelFormatCacheEntry> entries;
+} PixelFormatCache;
+
+PixelFormatCache& GetPixelFormatCache() {
+  static PixelFormatCache cache;
+  return cache;
+}
+
+bool GraphicsWindow::ApplyPixelFormat(const PIXELFORMATDESCRIPTOR& pfd) {
+  PixelFormatCache& cache = GetPixelFormatCache();
+  int32 format = 0;
+  {
+    ::std::lock_guard<::std::mutex> lock(cache.mutex);
+    for (const PixelFormatCacheEntry& entry : cache.entries) {
+      if (entry.color_bits == pfd.cColorBits &&
+          entry.depth_bits == pfd.cDepthBits) {
+        format = entry.format;
+        break;
+      }
+    }
+  }
+
+  // Format indices are specific to a device, so a cached format may be
+  // rejected if this window is on a different adapter. In that case we choose
+  // again and replace the cache entry.
+  if (format && SetPixelFormat(device_context_handle_, format, &pfd)) {
+    creation_stats_.reused_pixel_format = true;
+    return true;
+  }
+
+  format = ChoosePixelFormat(device_context_handle_, &pfd);
+  if (!format || !SetPixelFormat(device_context_handle_, format, &pfd)) {
+    return false;
+  }
+
+  ::std::lock_guard<::std::mutex> lock(cache.mutex);
+  PixelFormatCacheEntry entry = {pfd.cColorBits, pfd.cDepthBits, format};
+  for (PixelFormatCacheEntry& existing : cache.entries) {
+    if (existing.color_bits == entry.color_bits &&
+        existing.depth_bits == entry.depth_bits) {
+      existing = entry;
+      return true;
+    }
+  }
+  cache.entries.push_back(entry);
+  return true;
+}
+#endif
+
+void GraphicsWindow::LoadExtensions() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  LoadEntryPoint(&extensions_.swap_interval, "wglSwapIntervalEXT");
+  LoadEntryPoint(&extensions_.fence_sync, "glFenceSync");
+  LoadEntryPoint(&extensions_.client_wait_sync, "glClientWaitSync");
+  LoadEntryPoint(&extensions_.delete_sync, "glDeleteSync");
+  LoadEntryPoint(&extensions_.wait_sync, "glWaitSync");
+  LoadEntryPoint(&extensions_.create_context_attribs,
+                 "wglCreateContextAttribsARB");
+  LoadEntryPoint(&extensions_.gen_buffers, "glGenBuffers");
+  LoadEntryPoint(&extensions_.delete_buffers, "glDeleteBuffers");
+  LoadEntryPoint(&extensions_.bind_buffer, "glBindBuffer");
+  LoadEntryPoint(&extensions_.buffer_data, "glBufferData");
+  LoadEntryPoint(&extensions_.buffer_sub_data, "glBufferSubData");
+  LoadEntryPoint(&extensions_.unmap_buffer, "glUnmapBuffer");
+  LoadEntryPoint(&extensions_.map_buffer_range, "glMapBufferRange");
+  LoadEntryPoint(&extensions_.copy_buffer_sub_data, "glCopyBufferSubData");
+  LoadEntryPoint(&extensions_.buffer_storage, "glBufferStorage");
+
+  // Adaptive vsync is advertised through the WGL extension string rather than
+  // through a dedicated entry point.
+  const char*(APIENTRY * get_extensions_string)(void) = nullptr;
+  LoadEntryPoint(&get_extensions_string, "wglGetExtensionsStringEXT");
+
+  if (get_extensions_string) {
+    const char* wgl_extensions = get_extensions_string();
+    extensions_.supports_adaptive_vsync =
+        wgl_extensions && strstr(wgl_extensions, "WGL_EXT_swap_control_tear");
+  }
+
+  // The sync entry points are only useful as a complete set.
+  if (!extensions_.fence_sync || !extensions_.client_wait_sync ||
+      !extensions_.delete_sync || !extensions_.wait_sync) {
+    extensions_.fence_sync = nullptr;
+    extensions_.client_wait_sync = nullptr;
+    extensions_.delete_sync = nullptr;
+    extensions_.wait_sync = nullptr;
+  }
+#endif
+}
+
 void GraphicsWindow::DestroyGraphics() {
+  DrainFrameFences();
+  streaming_upload_.reset();
+
 #if defined(BASE_PLATFORM_WINDOWS)
   wglMakeCurrent(NULL, NULL);
   wglDeleteContext(graphics_handle_);
@@ -136,11 +771,58 @@ void GraphicsWindow::DestroyGraphics() {
 #endif
 }
 
-void GraphicsWindow::BeginScene() {
+bool GraphicsWindow::BeginScene() {
+  is_scene_skipped_ = false;
+
+  if (is_throttle_enabled_ && !IsVisible()) {
+    auto now = ::std::chrono::steady_clock::now();
+    float64 elapsed =
+        ::std::chrono::duration<float64>(now - last_hidden_frame_time_).count();
+    if (hidden_frame_interval_ <= 0 || elapsed < hidden_frame_interval_) {
+      uint32 timeout = kThrottledPollMilliseconds;
+      if (hidden_frame_interval_ > 0) {
+        timeout = ::std::min(
+            timeout, uint32((hidden_frame_interval_ - elapsed) * 1000.0));
+      }
+#if defined(BASE_PLATFORM_WINDOWS)
+      // Returns early if a message arrives, e.g. when the window is restored.
+      MsgWaitForMultipleObjects(0, NULL, FALSE, timeout, QS_ALLINPUT);
+#endif
+      is_scene_skipped_ = true;
+      return false;
+    }
+    last_hidden_frame_time_ = now;
+  }
+
+  // The default framebuffer is resized by the driver, so a resize only needs
+  // the viewport to be updated, once per frame at most.
+  bool is_resized = viewport_width_ != width_ || viewport_height_ != height_;
+  viewport_width_ = width_;
+  viewport_height_ = height_;
+
+  if (ShouldDeferToRenderThread()) {
+    AcquireFrameSlot();
+    recording_thread_.store(::std::this_thread::get_id(),
+                            ::std::memory_order_relaxed);
+    if (is_resized) {
+      uint32 width = width_, height = height_;
+      Submit([width, height] { glViewport(0, 0, width, height); });
+    }
+    return true;
+  }
+
 #if defined(BASE_PLATFORM_WINDOWS)
   wglMakeCurrent(device_context_handle_, graphics_handle_);
 #endif
 
+  ApplySceneState();
+  if (is_resized) {
+    glViewport(0, 0, width_, height_);
+  }
+  return true;
+}
+
+void GraphicsWindow::ApplySceneState() {
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_CULL_FACE);
   glEnable(GL_BLEND);
@@ -158,8 +840,41 @@ void GraphicsWindow::BeginScene() {
 }
 
 void GraphicsWindow::EndScene() {
+  Batch2D& batch = GetCurrentBatch();
+  if (is_scene_skipped_) {
+    batch.Clear();
+    is_scene_skipped_ = false;
+    return;
+  }
+
+  batch.Prepare(width_, height_);
+  batch_stats_ = batch.GetStats();
+
+  if (ShouldDeferToRenderThread()) {
+    // GetCurrentBatch has acquired the slot for us, even if BeginScene was
+    // never called.
+    uint64 slot = submitted_frames_.load(::std::memory_order_relaxed) %
+                  kRenderThreadFrameCount;
+    render_frames_[slot].push_back([&batch] { batch.Draw(); });
+    recording_thread_.store(::std::thread::id(), ::std::memory_order_relaxed);
+
+    // Publish the recorded frame. From this point on, the slot belongs to the
+    // render thread.
+    submitted_frames_.fetch_add(1, ::std::memory_order_release);
+#if defined(BASE_PLATFORM_WINDOWS)
+    SetEvent(frame_submitted_event_);
+#endif
+    return;
+  }
+
+  batch.Draw();
+  PresentScene();
+}
+
+void GraphicsWindow::PresentScene() {
 #if defined(BASE_PLATFORM_WINDOWS)
   SwapBuffers(device_context_handle_);
+  ThrottleFrames();
 #elif defined(BASE_PLATFORM_MACOS)
   [[m_hView openGLContext] flushBuffer];
 #elif defined(BASE_PLATFORM_IOS)
@@ -170,7 +885,17 @@ void GraphicsWindow::EndScene() {
 #endif
 }
 
+void GraphicsWindow::SetRenderThrottle(bool enabled, float32 hidden_frame_rate) {
+  is_throttle_enabled_ = enabled;
+  hidden_frame_interval_ = hidden_frame_rate > 0 ? 1.0 / hidden_frame_rate : 0;
+}
+
 void GraphicsWindow::Resolve() {
+  if (ShouldDeferToRenderThread()) {
+    Submit([] { glFlush(); });
+    return;
+  }
+
 #if defined(BASE_PLATFORM_WINDOWS)
   wglMakeCurrent(device_context_handle_, graphics_handle_);
 #endif
@@ -178,6 +903,869 @@ void GraphicsWindow::Resolve() {
   glFlush();
 }
 
+bool GraphicsWindow::SetSwapInterval(int32 interval) {
+  if (!extensions_.swap_interval) {
+    return false;
+  }
+
+  if (ShouldDeferToRenderThread()) {
+    // The swap interval belongs to the context, so it must be set from the
+    // render thread. We wait for it to be applied, which takes at most the
+    // remainder of the frame that the render thread is working on.
+    ::std::promise<bool> result;
+    ::std::future<bool> is_applied = result.get_future();
+    PostRenderCommand([this, interval, &result] {
+      result.set_value(SetSwapInterval(interval));
+    });
+    return is_applied.get();
+  }
+
+  if (interval < 0 && !extensions_.supports_adaptive_vsync) {
+    // Fall back to regular vsync at the requested rate rather than failing
+    // outright, since this is the closest behavior the driver can provide.
+    interval = -interval;
+  }
+
+  return !!extensions_.swap_interval(interval);
+}
+
+void GraphicsWindow::SetMaxFramesInFlight(uint32 frame_count) {
+  if (frame_count > kMaxFramesInFlight) {
+    frame_count = kMaxFramesInFlight;
+  }
+
+  if (ShouldDeferToRenderThread()) {
+    Submit([this, frame_count] { SetMaxFramesInFlight(frame_count); });
+    return;
+  }
+
+  // Our fence ring is indexed by max_frames_in_flight_, so we flush it before
+  // changing the ring size.
+  DrainFrameFences();
+  max_frames_in_flight_ = frame_count;
+}
+
+void GraphicsWindow::ThrottleFrames() {
+  if (!max_frames_in_flight_ || !extensions_.fence_sync) {
+    return;
+  }
+
+  // Each frame is tagged with a fence as soon as it is submitted. We then wait
+  // on the fence belonging to the oldest frame that would exceed our budget.
+  // With a budget of one frame, this is the frame we just submitted.
+  uint32 current_slot = frame_count_ % max_frames_in_flight_;
+  uint32 oldest_slot = (frame_count_ + 1) % max_frames_in_flight_;
+
+  frame_fences_[current_slot] =
+      extensions_.fence_sync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  GLsync& oldest_fence = frame_fences_[oldest_slot];
+
+  if (oldest_fence) {
+    // The flush bit guarantees that the fence will eventually signal, and we
+    // wait in bounded increments so that a lost device cannot hang us forever.
+    GLenum result = GL_TIMEOUT_EXPIRED;
+    for (uint32 i = 0; i < 10 && GL_TIMEOUT_EXPIRED == result; i++) {
+      result = extensions_.client_wait_sync(
+          oldest_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+    }
+
+    extensions_.delete_sync(oldest_fence);
+    oldest_fence = nullptr;
+  }
+
+  frame_count_++;
+}
+
+void GraphicsWindow::DrainFrameFences() {
+  if (!extensions_.delete_sync) {
+    return;
+  }
+
+  for (uint32 i = 0; i < kMaxFramesInFlight; i++) {
+    if (frame_fences_[i]) {
+      extensions_.client_wait_sync(frame_fences_[i],
+                                   GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+      extensions_.delete_sync(frame_fences_[i]);
+      frame_fences_[i] = nullptr;
+    }
+  }
+
+  frame_count_ = 0;
+}
+
+bool GraphicsWindow::ShouldDeferToRenderThread() const {
+  ::std::thread::id render_thread_id =
+      render_thread_id_.load(::std::memory_order_acquire);
+  return render_thread_id != ::std::thread::id() &&
+         ::std::this_thread::get_id() != render_thread_id;
+}
+
+bool GraphicsWindow::StartRenderThread() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  if (!is_valid_ || !graphics_handle_ ||
+      render_thread_id_.load(::std::memory_order_acquire) !=
+          ::std::thread::id()) {
+    return false;
+  }
+
+  frame_submitted_event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+  frame_completed_event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+  if (!frame_submitted_event_ || !frame_completed_event_) {
+    if (frame_submitted_event_) CloseHandle(frame_submitted_event_);
+    if (frame_completed_event_) CloseHandle(frame_completed_event_);
+    return false;
+  }
+
+  submitted_frames_ = 0;
+  completed_frames_ = 0;
+  render_thread_stopping_ = false;
+
+  // A context may only be current on a single thread at a time, so we release
+  // it here before the render thread claims it.
+  wglMakeCurrent(NULL, NULL);
+  render_thread_ = ::std::thread(&GraphicsWindow::RenderThreadMain, this);
+  render_thread_id_.store(render_thread_.get_id(), ::std::memory_order_release);
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+void GraphicsWindow::StopRenderThread() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  if (!ShouldDeferToRenderThread()) {
+    return;
+  }
+
+  render_thread_stopping_.store(true, ::std::memory_order_release);
+  SetEvent(frame_submitted_event_);
+  render_thread_.join();
+  render_thread_id_.store(::std::thread::id(), ::std::memory_order_release);
+
+  CloseHandle(frame_submitted_event_);
+  CloseHandle(frame_completed_event_);
+  frame_submitted_event_ = NULL;
+  frame_completed_event_ = NULL;
+
+  // Any commands recorded after the final EndScene are discarded, as they
+  // were never part of a complete frame.
+  for (auto& frame : render_frames_) {
+    frame.clear();
+  }
+  recording_thread_.store(::std::thread::id(), ::std::memory_order_relaxed);
+
+  wglMakeCurrent(device_context_handle_, graphics_handle_);
+
+  // Commands queued outside of a frame are not tied to one, so any that the
+  // render thread missed are run here rather than discarded.
+  RunRenderCommands();
+#endif
+}
+
+void GraphicsWindow::Submit(::std::function<void()> command) {
+  if (!ShouldDeferToRenderThread()) {
+    command();
+    return;
+  }
+
+  // Only the thread recording the frame owns its slot. Everyone else goes
+  // through the locked queue, which the render thread drains between frames.
+  if (recording_thread_.load(::std::memory_order_relaxed) !=
+      ::std::this_thread::get_id()) {
+    PostRenderCommand(::std::move(command));
+    return;
+  }
+
+  uint64 slot = submitted_frames_.load(::std::memory_order_relaxed) %
+                kRenderThreadFrameCount;
+  render_frames_[slot].push_back(::std::move(command));
+}
+
+void GraphicsWindow::AcquireFrameSlot() {
+  while (submitted_frames_.load(::std::memory_order_relaxed) -
+             completed_frames_.load(::std::memory_order_acquire) >=
+         kRenderThreadFrameCount) {
+#if defined(BASE_PLATFORM_WINDOWS)
+    WaitForSingleObject(frame_completed_event_, INFINITE);
+#endif
+  }
+}
+
+void GraphicsWindow::PostRenderCommand(::std::function<void()> command) {
+  {
+    ::std::lock_guard<::std::mutex> lock(render_commands_mutex_);
+    render_commands_.push_back(::std::move(command));
+  }
+#if defined(BASE_PLATFORM_WINDOWS)
+  SetEvent(frame_submitted_event_);
+#endif
+}
+
+void GraphicsWindow::RunRenderCommands() {
+  {
+    // Swapping (rather than moving) the queues preserves the capacity of
+    // both, so steady state submission does not reallocate.
+    ::std::lock_guard<::std::mutex> lock(render_commands_mutex_);
+    running_commands_.swap(render_commands_);
+  }
+
+  for (auto& command : running_commands_) {
+    command();
+  }
+  running_commands_.clear();
+}
+
+void GraphicsWindow::RenderThreadMain() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  wglMakeCurrent(device_context_handle_, graphics_handle_);
+
+  while (true) {
+    RunRenderCommands();
+
+    uint64 completed = completed_frames_.load(::std::memory_order_relaxed);
+
+    if (completed == submitted_frames_.load(::std::memory_order_acquire)) {
+      // We only honor a stop request once every submitted frame has been
+      // rendered, so that StopRenderThread never drops a complete frame.
+      if (render_thread_stopping_.load(::std::memory_order_acquire)) {
+        break;
+      }
+      WaitForSingleObject(frame_submitted_event_, INFINITE);
+      continue;
+    }
+
+    auto& frame = render_frames_[completed % kRenderThreadFrameCount];
+
+    ApplySceneState();
+    for (auto& command : frame) {
+      command();
+    }
+    PresentScene();
+
+    // Clearing (rather than releasing) the frame preserves its capacity, so
+    // steady state recording does not reallocate the command buffer.
+    frame.clear();
+    completed_frames_.store(completed + 1, ::std::memory_order_release);
+    SetEvent(frame_completed_event_);
+  }
+
+  wglMakeCurrent(NULL, NULL);
+#endif
+}
+
+::std::unique_ptr<SharedGraphicsContext> GraphicsWindow::CreateSharedContext() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  if (!is_valid_ || !graphics_handle_) {
+    return nullptr;
+  }
+
+  HGLRC shared_handle = NULL;
+
+  if (extensions_.create_context_attribs) {
+    // Sharing at creation time is the most reliable option, as wglShareLists
+    // may fail on some drivers once the source context is in use.
+    const int attributes[] = {0};
+    shared_handle = extensions_.create_context_attribs(
+        device_context_handle_, graphics_handle_, attributes);
+  } else {
+    shared_handle = wglCreateContext(device_context_handle_);
+
+    if (shared_handle && !wglShareLists(graphics_handle_, shared_handle)) {
+      wglDeleteContext(shared_handle);
+      shared_handle = NULL;
+    }
+  }
+
+  if (!shared_handle) {
+    return nullptr;
+  }
+
+  return ::std::unique_ptr<SharedGraphicsContext>(new SharedGraphicsContext(
+      device_context_handle_, shared_handle, &extensions_));
+#else
+  return nullptr;
+#endif
+}
+
+void GraphicsWindow::WaitForFence(GLsync fence) {
+  if (!fence || !extensions_.wait_sync) {
+    return;
+  }
+
+  if (ShouldDeferToRenderThread()) {
+    Submit([this, fence] { WaitForFence(fence); });
+    return;
+  }
+
+  extensions_.wait_sync(fence, 0, GL_TIMEOUT_IGNORED);
+  extensions_.delete_sync(fence);
+}
+
+#if defined(BASE_PLATFORM_WINDOWS)
+SharedGraphicsContext::SharedGraphicsContext(
+    HDC device_context_handle, HGLRC graphics_handle,
+    const GraphicsExtensions* extensions)
+    : device_context_handle_(device_context_handle),
+      graphics_handle_(graphics_handle),
+      extensions_(extensions) {}
+#endif
+
+SharedGraphicsContext::~SharedGraphicsContext() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  if (wglGetCurrentContext() == graphics_handle_) {
+    wglMakeCurrent(NULL, NULL);
+  }
+
+  wglDeleteContext(graphics_handle_);
+#endif
+}
+
+bool SharedGraphicsContext::MakeCurrent() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  return !!wglMakeCurrent(device_context_handle_, graphics_handle_);
+#else
+  return false;
+#endif
+}
+
+void SharedGraphicsContext::Release() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  wglMakeCurrent(NULL, NULL);
+#endif
+}
+
+GLsync SharedGraphicsContext::InsertFence() {
+  if (!extensions_->fence_sync) {
+    // Without fences the only safe handoff is to drain this context entirely.
+    glFinish();
+    return nullptr;
+  }
+
+  GLsync fence = extensions_->fence_sync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  // The fence must reach the GPU before another context can wait on it,
+  // otherwise the waiting context could stall indefinitely.
+  glFlush();
+  return fence;
+}
+
+void* GraphicsWindow::MapStreamingUpload(uint32 size) {
+  if (!streaming_upload_) {
+    streaming_upload_.reset(new StreamingUploadBuffer(&extensions_));
+  }
+
+  return streaming_upload_->Map(size);
+}
+
+bool GraphicsWindow::StreamTexture(GLuint texture, int32 x, int32 y,
+                                   uint32 width, uint32 height, GLenum format,
+                                   GLenum type) {
+  return streaming_upload_ &&
+         streaming_upload_->StreamTexture(texture, x, y, width, height, format,
+                                          type);
+}
+
+bool GraphicsWindow::StreamBuffer(GLuint buffer, uint32 offset) {
+  return streaming_upload_ && streaming_upload_->StreamBuffer(buffer, offset);
+}
+
+StreamingUploadBuffer::StreamingUploadBuffer(
+    const GraphicsExtensions* extensions)
+    : extensions_(extensions),
+      mode_(StreamingModeClient),
+      ring_buffer_(0),
+      ring_memory_(nullptr),
+      ring_size_(0),
+      segment_size_(0),
+      head_(0),
+      head_segment_(0),
+      staged_offset_(0),
+      staged_size_(0),
+      is_mapped_(false),
+      segment_fences_() {}
+
+StreamingUploadBuffer::~StreamingUploadBuffer() { DestroyRing(); }
+
+bool StreamingUploadBuffer::CreateRing(uint32 segment_size) {
+  if (segment_size > kMaxStreamingUploadSegmentSize) {
+    return false;
+  }
+
+  DestroyRing();
+
+  // Round segments up to a power of two so that repeated growth is rare.
+  uint32 default_segment_size =
+      kDefaultStreamingUploadSize / kStreamingUploadSegmentCount;
+  segment_size_ = default_segment_size;
+  while (segment_size_ < segment_size) {
+    segment_size_ <<= 1;
+  }
+
+  ring_size_ = segment_size_ * kStreamingUploadSegmentCount;
+
+  // Buffer uploads from the ring are copies between buffer objects, so we
+  // only use a ring buffer object if the driver can perform them.
+  bool has_buffers = extensions_->gen_buffers && extensions_->bind_buffer &&
+                     extensions_->buffer_data && extensions_->unmap_buffer &&
+                     extensions_->map_buffer_range &&
+                     extensions_->copy_buffer_sub_data;
+
+  if (has_buffers) {
+    extensions_->gen_buffers(1, &ring_buffer_);
+    extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer_);
+
+    if (extensions_->buffer_storage && extensions_->fence_sync) {
+      GLbitfield flags =
+          GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      extensions_->buffer_storage(GL_PIXEL_UNPACK_BUFFER, ring_size_, nullptr,
+                                  flags);
+      ring_memory_ = static_cast<uint8*>(extensions_->map_buffer_range(
+          GL_PIXEL_UNPACK_BUFFER, 0, ring_size_, flags));
+      mode_ = StreamingModePersistent;
+    }
+
+    if (!ring_memory_) {
+      // Buffer storage is immutable, so if the persistent mapping failed we
+      // need a fresh buffer object before falling back to orphaning.
+      if (StreamingModePersistent == mode_) {
+        extensions_->delete_buffers(1, &ring_buffer_);
+        extensions_->gen_buffers(1, &ring_buffer_);
+        extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer_);
+      }
+
+      extensions_->buffer_data(GL_PIXEL_UNPACK_BUFFER, ring_size_, nullptr,
+                               GL_STREAM_DRAW);
+      mode_ = StreamingModeOrphan;
+    }
+
+    extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  } else {
+    client_memory_.resize(ring_size_);
+    ring_memory_ = client_memory_.data();
+    mode_ = StreamingModeClient;
+  }
+
+  return true;
+}
+
+void StreamingUploadBuffer::DestroyRing() {
+  Unmap();
+
+  for (auto& fence : segment_fences_) {
+    if (fence) {
+      extensions_->delete_sync(fence);
+      fence = nullptr;
+    }
+  }
+
+  if (ring_buffer_) {
+    if (StreamingModePersistent == mode_) {
+      extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer_);
+      extensions_->unmap_buffer(GL_PIXEL_UNPACK_BUFFER);
+      extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    extensions_->delete_buffers(1, &ring_buffer_);
+    ring_buffer_ = 0;
+  }
+
+  client_memory_.clear();
+  ring_memory_ = nullptr;
+  ring_size_ = 0;
+  head_ = 0;
+  head_segment_ = 0;
+}
+
+void StreamingUploadBuffer::AdvanceSegment() {
+  if (extensions_->fence_sync) {
+    segment_fences_[head_segment_] =
+        extensions_->fence_sync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  head_segment_ = (head_segment_ + 1) % kStreamingUploadSegmentCount;
+  GLsync& fence = segment_fences_[head_segment_];
+
+  if (fence) {
+    GLenum result = GL_TIMEOUT_EXPIRED;
+    for (uint32 i = 0; i < 10 && GL_TIMEOUT_EXPIRED == result; i++) {
+      result = extensions_->client_wait_sync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                             100000000);
+    }
+
+    extensions_->delete_sync(fence);
+    fence = nullptr;
+  }
+}
+
+void* StreamingUploadBuffer::Map(uint32 size) {
+  if (!size) {
+    return nullptr;
+  }
+
+  Unmap();
+
+  if (size > segment_size_ && !CreateRing(size)) {
+    return nullptr;
+  }
+
+  // Reservations are aligned for the benefit of the driver's DMA engine and
+  // of any SIMD code that fills them.
+  uint32 begin = (head_ + 63) & ~63u;
+  uint32 segment = begin / segment_size_;
+
+  // A reservation never spans two segments. A segment's fence is placed when
+  // the head leaves it, which must follow the copies of everything within
+  // it, so a reservation that straddled a boundary would be copied after the
+  // fence that guards it. Instead we skip ahead to the next segment.
+  if (begin + size > (segment + 1) * segment_size_) {
+    begin = (segment + 1) * segment_size_;
+  }
+  if (begin + size > ring_size_) {
+    begin = 0;
+  }
+  segment = begin / segment_size_;
+
+  if (StreamingModePersistent == mode_) {
+    while (head_segment_ != segment) {
+      AdvanceSegment();
+    }
+  } else {
+    head_segment_ = segment;
+  }
+
+  staged_offset_ = begin;
+  staged_size_ = size;
+  head_ = begin + size;
+
+  if (StreamingModeOrphan == mode_) {
+    extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer_);
+
+    if (0 == begin) {
+      // Orphaning hands us fresh storage while the driver retains the old
+      // storage until the GPU has finished with it, so no fences are needed.
+      extensions_->buffer_data(GL_PIXEL_UNPACK_BUFFER, ring_size_, nullptr,
+                               GL_STREAM_DRAW);
+    }
+
+    void* memory = extensions_->map_buffer_range(
+        GL_PIXEL_UNPACK_BUFFER, begin, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+            GL_MAP_UNSYNCHRONIZED_BIT);
+    extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    is_mapped_ = !!memory;
+    return memory;
+  }
+
+  return ring_memory_ + begin;
+}
+
+void StreamingUploadBuffer::Unmap() {
+  if (!is_mapped_) {
+    return;
+  }
+
+  extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer_);
+  extensions_->unmap_buffer(GL_PIXEL_UNPACK_BUFFER);
+  extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  is_mapped_ = false;
+}
+
+bool StreamingUploadBuffer::StreamTexture(GLuint texture, int32 x, int32 y,
+                                          uint32 width, uint32 height,
+                                          GLenum format, GLenum type) {
+  if (!staged_size_) {
+    return false;
+  }
+
+  Unmap();
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  if (StreamingModeClient == mode_) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format, type,
+                    ring_memory_ + staged_offset_);
+  } else {
+    // With a pixel unpack buffer bound, the data pointer is interpreted as an
+    // offset into the buffer and the copy is performed by the GPU.
+    extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer_);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format, type,
+                    reinterpret_cast<const void*>(
+                        static_cast<uintptr_t>(staged_offset_)));
+    extensions_->bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  staged_size_ = 0;
+  return true;
+}
+
+bool StreamingUploadBuffer::StreamBuffer(GLuint buffer, uint32 offset) {
+  if (!staged_size_) {
+    return false;
+  }
+
+  Unmap();
+  uint32 size = staged_size_;
+  staged_size_ = 0;
+
+  if (StreamingModeClient != mode_) {
+    // The ring only uses a buffer object if copies are supported.
+    extensions_->bind_buffer(GL_COPY_READ_BUFFER, ring_buffer_);
+    extensions_->bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+    extensions_->copy_buffer_sub_data(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                      staged_offset_, offset, size);
+    extensions_->bind_buffer(GL_COPY_READ_BUFFER, 0);
+    extensions_->bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+    return true;
+  }
+
+  // Without buffer copies we upload from client memory, through a binding
+  // point that exists in every version with buffer objects.
+  if (!extensions_->bind_buffer || !extensions_->buffer_sub_data) {
+    return false;
+  }
+
+  extensions_->bind_buffer(GL_ARRAY_BUFFER, buffer);
+  extensions_->buffer_sub_data(GL_ARRAY_BUFFER, offset, size,
+                               ring_memory_ + staged_offset_);
+  extensions_->bind_buffer(GL_ARRAY_BUFFER, 0);
+  return true;
+}
+
+Batch2D& GraphicsWindow::GetCurrentBatch() {
+  // Primitives may be queued between frames, while the render thread is still
+  // drawing the batch in this slot.
+  if (ShouldDeferToRenderThread()) {
+    AcquireFrameSlot();
+  }
+
+  return batches_[submitted_frames_.load(::std::memory_order_relaxed) %
+                  kRenderThreadFrameCount];
+}
+
+void GraphicsWindow::DrawQuad(float32 x, float32 y, float32 width,
+                              float32 height, uint32 color, BlendMode blend) {
+  GetCurrentBatch().AddQuad(x, y, width, height, color, 0, 0, 0, 0, 0, blend,
+                            batch_layer_);
+}
+
+void GraphicsWindow::DrawQuad(float32 x, float32 y, float32 width,
+                              float32 height, uint32 color, GLuint texture,
+                              float32 u0, float32 v0, float32 u1, float32 v1,
+                              BlendMode blend) {
+  GetCurrentBatch().AddQuad(x, y, width, height, color, texture, u0, v0, u1,
+                            v1, blend, batch_layer_);
+}
+
+void GraphicsWindow::DrawLine(float32 x0, float32 y0, float32 x1, float32 y1,
+                              uint32 color, BlendMode blend) {
+  GetCurrentBatch().AddLine(x0, y0, x1, y1, color, blend, batch_layer_);
+}
+
+void GraphicsWindow::DrawPoint(float32 x, float32 y, uint32 color,
+                               BlendMode blend) {
+  GetCurrentBatch().AddPoint(x, y, color, blend, batch_layer_);
+}
+
+void GraphicsWindow::SetBatchLayer(uint16 layer) { batch_layer_ = layer; }
+
+const BatchStats& GraphicsWindow::GetBatchStats() const { return batch_stats_; }
+
+Batch2D::Batch2D() : width_(0), height_(0), stats_() {}
+
+void Batch2D::Clear() {
+  vertices_.clear();
+  primitives_.clear();
+  indices_.clear();
+  runs_.clear();
+}
+
+const BatchStats& Batch2D::GetStats() const { return stats_; }
+
+uint64 Batch2D::MakeKey(uint16 layer, BlendMode blend, BatchPrimitiveType type,
+                        GLuint texture) {
+  // Layer is the most significant field since it defines draw order. Blend
+  // mode and primitive type follow, as they are the most expensive state
+  // changes after the layer.
+  return (uint64(layer) << 48) | (uint64(blend) << 40) | (uint64(type) << 32) |
+         uint64(texture);
+}
+
+void Batch2D::AddVertex(float32 x, float32 y, float32 u, float32 v,
+                        uint32 color) {
+  BatchVertex vertex = {x, y, u, v, color};
+  vertices_.push_back(vertex);
+}
+
+void Batch2D::AddQuad(float32 x, float32 y, float32 width, float32 height,
+                      uint32 color, GLuint texture, float32 u0, float32 v0,
+                      float32 u1, float32 v1, BlendMode blend, uint16 layer) {
+  BatchPrimitive primitive = {
+      MakeKey(layer, blend, BatchPrimitiveQuad, texture),
+      static_cast<uint32>(vertices_.size())};
+  primitives_.push_back(primitive);
+
+  AddVertex(x, y, u0, v0, color);
+  AddVertex(x, y + height, u0, v1, color);
+  AddVertex(x + width, y + height, u1, v1, color);
+  AddVertex(x + width, y, u1, v0, color);
+}
+
+void Batch2D::AddLine(float32 x0, float32 y0, float32 x1, float32 y1,
+                      uint32 color, BlendMode blend, uint16 layer) {
+  BatchPrimitive primitive = {MakeKey(layer, blend, BatchPrimitiveLine, 0),
+                              static_cast<uint32>(vertices_.size())};
+  primitives_.push_back(primitive);
+
+  AddVertex(x0, y0, 0, 0, color);
+  AddVertex(x1, y1, 0, 0, color);
+}
+
+void Batch2D::AddPoint(float32 x, float32 y, uint32 color, BlendMode blend,
+                       uint16 layer) {
+  BatchPrimitive primitive = {MakeKey(layer, blend, BatchPrimitivePoint, 0),
+                              static_cast<uint32>(vertices_.size())};
+  primitives_.push_back(primitive);
+
+  AddVertex(x, y, 0, 0, color);
+}
+
+void Batch2D::Prepare(uint32 width, uint32 height) {
+  width_ = width;
+  height_ = height;
+  indices_.clear();
+  runs_.clear();
+
+  // Primitives that share a key keep their submission order, which is all the
+  // ordering that we guarantee. Vertices are allocated in submission order, so
+  // breaking ties on first_vertex gives the same result as a stable sort
+  // without the temporary buffer that std::stable_sort allocates.
+  ::std::sort(primitives_.begin(), primitives_.end(),
+              [](const BatchPrimitive& lhs, const BatchPrimitive& rhs) {
+                return lhs.key < rhs.key ||
+                       (lhs.key == rhs.key &&
+                        lhs.first_vertex < rhs.first_vertex);
+              });
+
+  for (auto& primitive : primitives_) {
+    if (runs_.empty() || runs_.back().key != primitive.key) {
+      BatchRun run = {primitive.key, static_cast<uint32>(indices_.size()), 0};
+      runs_.push_back(run);
+    }
+
+    uint32 v = primitive.first_vertex;
+    switch (static_cast<BatchPrimitiveType>((primitive.key >> 32) & 0xFF)) {
+      case BatchPrimitiveQuad: {
+        const uint32 quad_indices[] = {v, v + 1, v + 2, v, v + 2, v + 3};
+        indices_.insert(indices_.end(), quad_indices, quad_indices + 6);
+      } break;
+      case BatchPrimitiveLine: {
+        indices_.push_back(v);
+        indices_.push_back(v + 1);
+      } break;
+      case BatchPrimitivePoint: {
+        indices_.push_back(v);
+      } break;
+    }
+  }
+
+  for (uint32 i = 0; i < runs_.size(); i++) {
+    uint32 end = (i + 1 < runs_.size()) ? runs_[i + 1].first_index
+                                        : static_cast<uint32>(indices_.size());
+    runs_[i].index_count = end - runs_[i].first_index;
+  }
+
+  stats_.draw_calls = static_cast<uint32>(runs_.size());
+  stats_.primitives = static_cast<uint32>(primitives_.size());
+  stats_.vertices = static_cast<uint32>(vertices_.size());
+}
+
+void Batch2D::Draw() {
+  if (runs_.empty()) {
+    Clear();
+    return;
+  }
+
+  // We restore all of the state that we touch, so that the batcher can be
+  // mixed freely with the app's own rendering.
+  glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT |
+               GL_POINT_BIT | GL_DEPTH_BUFFER_BIT);
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0, width_, height_, 0, -1, 1);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_CULL_FACE);
+  glPointSize(1.0f);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, sizeof(BatchVertex), &vertices_[0].x);
+  glTexCoordPointer(2, GL_FLOAT, sizeof(BatchVertex), &vertices_[0].u);
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(BatchVertex),
+                 &vertices_[0].color);
+
+  for (auto& run : runs_) {
+    BlendMode blend = static_cast<BlendMode>((run.key >> 40) & 0xFF);
+    GLuint texture = static_cast<GLuint>(run.key & 0xFFFFFFFF);
+
+    switch (blend) {
+      case BlendModeOpaque:
+        glDisable(GL_BLEND);
+        break;
+      case BlendModeAlpha:
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        break;
+      case BlendModeAdditive:
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+        break;
+    }
+
+    // Texture zero is incomplete and would sample as black, so untextured
+    // primitives disable texturing entirely.
+    if (texture) {
+      glEnable(GL_TEXTURE_2D);
+      glBindTexture(GL_TEXTURE_2D, texture);
+    } else {
+      glDisable(GL_TEXTURE_2D);
+    }
+
+    GLenum mode = GL_TRIANGLES;
+    switch (static_cast<BatchPrimitiveType>((run.key >> 32) & 0xFF)) {
+      case BatchPrimitiveQuad:
+        mode = GL_TRIANGLES;
+        break;
+      case BatchPrimitiveLine:
+        mode = GL_LINES;
+        break;
+      case BatchPrimitivePoint:
+        mode = GL_POINTS;
+        break;
+    }
+
+    glDrawElements(mode, run.index_count, GL_UNSIGNED_INT,
+                   &indices_[run.first_index]);
+  }
+
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+  glPopClientAttrib();
+  glPopAttrib();
+
+  Clear();
+}
+
 }  // namespace base
 
 #endif  // __BASE_GRAPHICS_H__
@@ -0,0 +1,225 @@
+/*
+//
+// Copyright (c) 1998-2019 Joe Bertolami. All Right Reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, CLUDG, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//   ARE DISCLAIMED.  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//   LIABLE FOR ANY DIRECT, DIRECT, CIDENTAL, SPECIAL, EXEMPLARY, OR
+//   CONSEQUENTIAL DAMAGES (CLUDG, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+//   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSESS TERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER  CONTRACT, STRICT
+//   LIABILITY, OR TORT (CLUDG NEGLIGENCE OR OTHERWISE) ARISG  ANY WAY  OF THE
+//   USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+//
+*/
+
+
+
+#ifndef __BASE_LOOP_H__
+#define __BASE_LOOP_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#include "base_graphics.h"
+
+namespace base {
+
+// The default simulation rate, in steps per second.
+const float64 kDefaultStepRate = 60.0;
+// The default limit on simulation steps run within a single frame.
+const uint32 kDefaultMaxStepsPerFrame = 5;
+
+typedef struct FrameLoopStats {
+  // The number of frames rendered and simulation steps run.
+  uint64 frames;
+  uint64 steps;
+  // Frames that took longer than the late frame threshold.
+  uint64 late_frames;
+  // Simulation steps skipped because a frame hit the catch-up limit.
+  uint64 dropped_steps;
+  // The duration of the most recent frame, and the longest so far, in seconds.
+  float64 last_frame_seconds;
+  float64 max_frame_seconds;
+} FrameLoopStats;
+
+// Drives a GraphicsWindow with a fixed simulation timestep. Each frame calls
+// Update, then runs the simulation as many times as needed to catch up with
+// real time, and then renders once between BeginScene and EndScene. Render is
+// given the fraction of a step that has accumulated but not yet been
+// simulated, so that it can interpolate between the last two simulation
+// states.
+//
+// If a frame falls so far behind that it would need more than the maximum
+// number of steps, the excess time is discarded rather than carried into the
+// next frame. This keeps one slow frame from causing a chain of slower ones,
+// at the cost of the simulation briefly running slower than real time.
+class FrameLoop {
+ public:
+  // Called once per simulation step with the step length in seconds, and the
+  // input events received since the previous step.
+  typedef ::std::function<void(float64 step_seconds,
+                               const ::std::vector<InputEvent>& events)>
+      StepFunction;
+  // Called once per frame with the interpolation alpha, in [0, 1).
+  typedef ::std::function<void(float64 alpha)> RenderFunction;
+
+  // Creates a loop that simulates window at step_rate steps per second. The
+  // window must outlive the loop.
+  FrameLoop(GraphicsWindow* window, float64 step_rate = kDefaultStepRate,
+            uint32 max_steps_per_frame = kDefaultMaxStepsPerFrame);
+  FrameLoop(const FrameLoop& rhs) = delete;
+
+  // Runs frames until the window is closed.
+  void Run(const StepFunction& step, const RenderFunction& render);
+  // Runs a single frame. Returns false if the window has been closed.
+  bool RunFrame(const StepFunction& step, const RenderFunction& render);
+  // Adds elapsed_seconds of real time to the loop, and returns the number of
+  // simulation steps that are now due. RunFrame calls this with the measured
+  // frame time; it is public so that loops may be driven by other clocks.
+  uint32 Advance(float64 elapsed_seconds);
+  // Returns the fraction of a step accumulated since the last step was run.
+  float64 GetAlpha() const;
+  // Returns the length of a simulation step, in seconds.
+  float64 GetStepSeconds() const;
+  // Sets the frame time above which a frame is counted as late. Defaults to
+  // two simulation steps.
+  void SetLateFrameThreshold(float64 seconds);
+  // Returns true if the most recent frame was late.
+  bool WasLastFrameLate() const;
+  // Returns the loop's statistics since construction.
+  const FrameLoopStats& GetStats() const;
+
+ private:
+  GraphicsWindow* window_;
+  float64 step_seconds_;
+  uint32 max_steps_per_frame_;
+  float64 late_frame_threshold_;
+  // Real time that has not yet been simulated.
+  float64 accumulator_;
+  bool was_last_frame_late_;
+  bool is_started_;
+  ::std::chrono::steady_clock::time_point last_frame_time_;
+  // Events received from the window but not yet delivered to a step.
+  ::std::vector<InputEvent> pending_events_;
+  ::std::vector<InputEvent> frame_events_;
+  // Reused to deliver an empty event list to later steps within a frame.
+  const ::std::vector<InputEvent> no_events_;
+  FrameLoopStats stats_;
+};
+
+/* Implementation */
+
+FrameLoop::FrameLoop(GraphicsWindow* window, float64 step_rate,
+                     uint32 max_steps_per_frame)
+    : window_(window),
+      step_seconds_(1.0 / step_rate),
+      max_steps_per_frame_(::std::max(1u, max_steps_per_frame)),
+      late_frame_threshold_(2.0 / step_rate),
+      accumulator_(0),
+      was_last_frame_late_(false),
+      is_started_(false),
+      stats_() {}
+
+void FrameLoop::Run(const StepFunction& step, const RenderFunction& render) {
+  while (RunFrame(step, render)) {
+  }
+}
+
+bool FrameLoop::RunFrame(const StepFunction& step,
+                         const RenderFunction& render) {
+  if (!window_->IsValid()) {
+    return false;
+  }
+
+  window_->Update(&frame_events_);
+  pending_events_.insert(pending_events_.end(), frame_events_.begin(),
+                         frame_events_.end());
+
+  // The first frame has no previous frame to measure from, so it runs a
+  // single step.
+  auto now = ::std::chrono::steady_clock::now();
+  float64 elapsed =
+      is_started_
+          ? ::std::chrono::duration<float64>(now - last_frame_time_).count()
+          : step_seconds_;
+  last_frame_time_ = now;
+  is_started_ = true;
+
+  uint32 steps = Advance(elapsed);
+  for (uint32 i = 0; i < steps; i++) {
+    // Input is delivered to the first step that runs after it arrives. Frames
+    // that run no steps hold their input for the next one.
+    step(step_seconds_, i ? no_events_ : pending_events_);
+  }
+  if (steps) {
+    pending_events_.clear();
+  }
+
+  // Hidden windows may skip rendering while throttled.
+  if (window_->BeginScene()) {
+    render(GetAlpha());
+  }
+  window_->EndScene();
+  return true;
+}
+
+uint32 FrameLoop::Advance(float64 elapsed_seconds) {
+  accumulator_ += ::std::max(0.0, elapsed_seconds);
+  uint32 steps = uint32(accumulator_ / step_seconds_);
+
+  if (steps > max_steps_per_frame_) {
+    stats_.dropped_steps += steps - max_steps_per_frame_;
+    steps = max_steps_per_frame_;
+    // Keep the fractional step so that interpolation stays continuous.
+    accumulator_ = ::std::fmod(accumulator_, step_seconds_);
+  } else {
+    accumulator_ -= steps * step_seconds_;
+  }
+
+  was_last_frame_late_ = elapsed_seconds > late_frame_threshold_;
+  stats_.frames++;
+  stats_.steps += steps;
+  stats_.late_frames += was_last_frame_late_;
+  stats_.last_frame_seconds = elapsed_seconds;
+  stats_.max_frame_seconds =
+      ::std::max(stats_.max_frame_seconds, elapsed_seconds);
+  return steps;
+}
+
+float64 FrameLoop::GetAlpha() const {
+  return ::std::min(accumulator_ / step_seconds_, 1.0);
+}
+
+float64 FrameLoop::GetStepSeconds() const { return step_seconds_; }
+
+void FrameLoop::SetLateFrameThreshold(float64 seconds) {
+  late_frame_threshold_ = seconds;
+}
+
+bool FrameLoop::WasLastFrameLate() const { return was_last_frame_late_; }
+
+const FrameLoopStats& FrameLoop::GetStats() const { return stats_; }
+
+}  // namespace base
+
+#endif  // __BASE_LOOP_H__
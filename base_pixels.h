@@ -0,0 +1,698 @@
+/*
+//
+// Copyright (c) 1998-2019 Joe Bertolami. All Right Reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, CLUDG, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//   ARE DISCLAIMED.  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//   LIABLE FOR ANY DIRECT, DIRECT, CIDENTAL, SPECIAL, EXEMPLARY, OR
+//   CONSEQUENTIAL DAMAGES (CLUDG, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+//   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSESS TERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER  CONTRACT, STRICT
+//   LIABILITY, OR TORT (CLUDG NEGLIGENCE OR OTHERWISE) ARISG  ANY WAY  OF THE
+//   USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+//
+*/
+
+
+#ifndef __BASE_PIXELS_H__
+#define __BASE_PIXELS_H__
+
+#include "base_window.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || \
+    defined(__i386__)
+#define BASE_PIXELS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define BASE_PIXELS_NEON
+#include <arm_neon.h>
+#endif
+
+// MSVC will emit AVX2 instructions for intrinsics regardless of the target
+// architecture, while GCC and Clang require that each function opt in.
+#if defined(BASE_PIXELS_X86) && !defined(_MSC_VER)
+#define BASE_PIXELS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BASE_PIXELS_TARGET_AVX2
+#endif
+
+namespace base {
+
+// The instruction sets that the pixel kernels are implemented for. The scalar
+// kernels are always available and define the exact results that every other
+// set must reproduce.
+enum PixelKernelSet : uint8 {
+  PixelKernelSetScalar,
+  PixelKernelSetSSE2,
+  PixelKernelSetAVX2,
+  PixelKernelSetNEON,
+  PixelKernelSetCount,
+};
+
+// A table of span kernels for a single instruction set. Each kernel operates
+// on count consecutive pixels, and source and destination may not overlap
+// unless they are identical.
+typedef struct PixelKernels {
+  // A human readable name for the instruction set.
+  const char* name;
+  // Sets every pixel to color.
+  void (*fill)(uint32* dest, uint32 count, uint32 color);
+  // Composites source over dest using the (non-premultiplied) source alpha.
+  void (*blend)(uint32* dest, const uint32* source, uint32 count);
+  // Swaps the red and blue channels, converting between RGBA and BGRA.
+  void (*swap_red_blue)(uint32* dest, const uint32* source, uint32 count);
+  // Converts native pixels to 16 bit RGB 565, discarding alpha.
+  void (*to_rgb565)(uint16* dest, const uint32* source, uint32 count);
+  // Converts 16 bit RGB 565 to native pixels with opaque alpha.
+  void (*from_rgb565)(uint32* dest, const uint16* source, uint32 count);
+} PixelKernels;
+
+// Returns the fastest kernels supported by the host CPU. The selection is made
+// once, on first use.
+const PixelKernels& GetPixelKernels();
+// Returns the kernels for a specific instruction set, or null if the set is
+// not supported by the host CPU or by this build.
+const PixelKernels* GetPixelKernels(PixelKernelSet set);
+
+// Packs a color into the native pixel format of the window system.
+uint32 MakePixel(uint8 red, uint8 green, uint8 blue, uint8 alpha = 255);
+
+// Sets every pixel in buffer to color.
+void ClearPixels(const PixelBuffer& buffer, uint32 color);
+// Sets every pixel within a rectangle of buffer to color. The rectangle is
+// clipped to the buffer.
+void FillRect(const PixelBuffer& buffer, int32 x, int32 y, int32 width,
+              int32 height, uint32 color);
+// Composites source over dest, with the upper left corner of source placed at
+// (x, y) in dest. The source is clipped to dest.
+void BlendPixels(const PixelBuffer& dest, int32 x, int32 y,
+                 const PixelBuffer& source);
+// Copies source into dest while swapping red and blue. The buffers may be the
+// same, but may not otherwise overlap. Only the overlapping extent of the two
+// buffers is converted.
+void SwapRedBlue(const PixelBuffer& dest, const PixelBuffer& source);
+// Converts source into a 565 image with dest_stride pixels per row.
+void ConvertToRGB565(uint16* dest, uint32 dest_stride,
+                     const PixelBuffer& source);
+// Converts a 565 image with source_stride pixels per row into dest.
+void ConvertFromRGB565(const PixelBuffer& dest, const uint16* source,
+                       uint32 source_stride);
+
+/* Implementation */
+
+uint32 MakePixel(uint8 red, uint8 green, uint8 blue, uint8 alpha) {
+  return (uint32(alpha) << 24) | (uint32(red) << 16) | (uint32(green) << 8) |
+         uint32(blue);
+}
+
+// Scalar kernels.
+
+void FillScalar(uint32* dest, uint32 count, uint32 color) {
+  for (uint32 i = 0; i < count; i++) {
+    dest[i] = color;
+  }
+}
+
+// Computes (source * alpha + dest * (255 - alpha)) / 255 with exact rounding
+// for a single 8 bit channel. The SIMD kernels use the same formulation.
+uint32 BlendChannel(uint32 source, uint32 dest, uint32 alpha) {
+  uint32 value = source * alpha + dest * (255 - alpha) + 128;
+  return (value + (value >> 8)) >> 8;
+}
+
+void BlendScalar(uint32* dest, const uint32* source, uint32 count) {
+  for (uint32 i = 0; i < count; i++) {
+    uint32 s = source[i];
+    uint32 d = dest[i];
+    uint32 alpha = s >> 24;
+
+    // We blend two channels at a time, in alternating bytes. Each product is
+    // at most 16 bits wide, so the channels cannot carry into one another, and
+    // the result matches BlendChannel exactly.
+    uint32 even = (s & 0x00FF00FF) * alpha +
+                  (d & 0x00FF00FF) * (255 - alpha) + 0x00800080;
+    uint32 odd = ((s >> 8) & 0x00FF00FF) * alpha +
+                 ((d >> 8) & 0x00FF00FF) * (255 - alpha) + 0x00800080;
+    even = ((even + ((even >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    odd = (odd + ((odd >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+
+    dest[i] = even | odd;
+  }
+}
+
+void SwapRedBlueScalar(uint32* dest, const uint32* source, uint32 count) {
+  for (uint32 i = 0; i < count; i++) {
+    uint32 s = source[i];
+    dest[i] = (s & 0xFF00FF00) | ((s << 16) & 0x00FF0000) | ((s >> 16) & 0xFF);
+  }
+}
+
+void ToRGB565Scalar(uint16* dest, const uint32* source, uint32 count) {
+  for (uint32 i = 0; i < count; i++) {
+    uint32 s = source[i];
+    dest[i] = static_cast<uint16>(((s >> 8) & 0xF800) | ((s >> 5) & 0x07E0) |
+                                  ((s >> 3) & 0x001F));
+  }
+}
+
+void FromRGB565Scalar(uint32* dest, const uint16* source, uint32 count) {
+  for (uint32 i = 0; i < count; i++) {
+    uint32 s = source[i];
+    // Each channel is expanded to 8 bits by replicating its high bits into the
+    // vacated low bits, so that full intensity maps to 255.
+    uint32 red = (s >> 8) & 0xF8;
+    uint32 green = (s >> 3) & 0xFC;
+    uint32 blue = (s << 3) & 0xF8;
+    red |= red >> 5;
+    green |= green >> 6;
+    blue |= blue >> 5;
+    dest[i] = 0xFF000000 | (red << 16) | (green << 8) | blue;
+  }
+}
+
+#if defined(BASE_PIXELS_X86)
+
+// SSE2 kernels. Each processes a multiple of 4 or 8 pixels and defers any
+// remainder to the scalar kernel.
+
+void FillSSE2(uint32* dest, uint32 count, uint32 color) {
+  __m128i value = _mm_set1_epi32(color);
+  uint32 i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), value);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i + 4), value);
+  }
+
+  FillScalar(dest + i, count - i, color);
+}
+
+// Blends the 16 bit channels of two pixels. Alpha is broadcast from the top
+// channel of each pixel.
+__m128i BlendChannelsSSE2(__m128i source, __m128i dest) {
+  __m128i alpha = _mm_shufflelo_epi16(source, _MM_SHUFFLE(3, 3, 3, 3));
+  alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+  __m128i inverse_alpha = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+  __m128i value = _mm_add_epi16(_mm_mullo_epi16(source, alpha),
+                                _mm_mullo_epi16(dest, inverse_alpha));
+  value = _mm_add_epi16(value, _mm_set1_epi16(128));
+  value = _mm_add_epi16(value, _mm_srli_epi16(value, 8));
+  return _mm_srli_epi16(value, 8);
+}
+
+void BlendSSE2(uint32* dest, const uint32* source, uint32 count) {
+  __m128i zero = _mm_setzero_si128();
+  uint32 i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + i));
+    __m128i low = BlendChannelsSSE2(_mm_unpacklo_epi8(s, zero),
+                                    _mm_unpacklo_epi8(d, zero));
+    __m128i high = BlendChannelsSSE2(_mm_unpackhi_epi8(s, zero),
+                                     _mm_unpackhi_epi8(d, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     _mm_packus_epi16(low, high));
+  }
+
+  BlendScalar(dest + i, source + i, count - i);
+}
+
+void SwapRedBlueSSE2(uint32* dest, const uint32* source, uint32 count) {
+  __m128i green_alpha = _mm_set1_epi32(0xFF00FF00);
+  __m128i red = _mm_set1_epi32(0x00FF0000);
+  __m128i blue = _mm_set1_epi32(0x000000FF);
+  uint32 i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+    __m128i result = _mm_or_si128(
+        _mm_and_si128(s, green_alpha),
+        _mm_or_si128(_mm_and_si128(_mm_slli_epi32(s, 16), red),
+                     _mm_and_si128(_mm_srli_epi32(s, 16), blue)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), result);
+  }
+
+  SwapRedBlueScalar(dest + i, source + i, count - i);
+}
+
+// Converts four native pixels into 565 values held in 32 bit lanes. The
+// values are biased by 0x8000 so that they survive a signed 16 bit pack.
+__m128i PackRGB565SSE2(__m128i s) {
+  __m128i value = _mm_or_si128(
+      _mm_and_si128(_mm_srli_epi32(s, 8), _mm_set1_epi32(0xF800)),
+      _mm_or_si128(
+          _mm_and_si128(_mm_srli_epi32(s, 5), _mm_set1_epi32(0x07E0)),
+          _mm_and_si128(_mm_srli_epi32(s, 3), _mm_set1_epi32(0x001F))));
+  return _mm_sub_epi32(value, _mm_set1_epi32(0x8000));
+}
+
+void ToRGB565SSE2(uint16* dest, const uint32* source, uint32 count) {
+  __m128i bias = _mm_set1_epi16(static_cast<int16>(0x8000));
+  uint32 i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m128i low = PackRGB565SSE2(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)));
+    __m128i high = PackRGB565SSE2(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i + 4)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     _mm_xor_si128(_mm_packs_epi32(low, high), bias));
+  }
+
+  ToRGB565Scalar(dest + i, source + i, count - i);
+}
+
+// Expands four 565 values held in 32 bit lanes into native pixels.
+__m128i UnpackRGB565SSE2(__m128i s) {
+  __m128i red = _mm_and_si128(_mm_srli_epi32(s, 8), _mm_set1_epi32(0xF8));
+  __m128i green = _mm_and_si128(_mm_srli_epi32(s, 3), _mm_set1_epi32(0xFC));
+  __m128i blue = _mm_and_si128(_mm_slli_epi32(s, 3), _mm_set1_epi32(0xF8));
+  red = _mm_or_si128(red, _mm_srli_epi32(red, 5));
+  green = _mm_or_si128(green, _mm_srli_epi32(green, 6));
+  blue = _mm_or_si128(blue, _mm_srli_epi32(blue, 5));
+  return _mm_or_si128(
+      _mm_or_si128(_mm_set1_epi32(0xFF000000), _mm_slli_epi32(red, 16)),
+      _mm_or_si128(_mm_slli_epi32(green, 8), blue));
+}
+
+void FromRGB565SSE2(uint32* dest, const uint16* source, uint32 count) {
+  __m128i zero = _mm_setzero_si128();
+  uint32 i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     UnpackRGB565SSE2(_mm_unpacklo_epi16(s, zero)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i + 4),
+                     UnpackRGB565SSE2(_mm_unpackhi_epi16(s, zero)));
+  }
+
+  FromRGB565Scalar(dest + i, source + i, count - i);
+}
+
+// AVX2 kernels. These mirror the SSE2 kernels at twice the width, and hand
+// their remainder to the SSE2 kernels since short spans are common. We clear
+// the upper AVX state before doing so, as mixing AVX and legacy SSE code with
+// dirty upper registers incurs a large transition penalty. Note that
+// AVX2 unpack and pack instructions operate within 128 bit lanes, which is
+// harmless when an unpack is paired with the matching pack.
+
+BASE_PIXELS_TARGET_AVX2
+void FillAVX2(uint32* dest, uint32 count, uint32 color) {
+  __m256i value = _mm256_set1_epi32(color);
+  uint32 i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), value);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i + 8), value);
+  }
+
+  _mm256_zeroupper();
+  FillSSE2(dest + i, count - i, color);
+}
+
+BASE_PIXELS_TARGET_AVX2
+__m256i BlendChannelsAVX2(__m256i source, __m256i dest) {
+  __m256i alpha = _mm256_shufflelo_epi16(source, _MM_SHUFFLE(3, 3, 3, 3));
+  alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+  __m256i inverse_alpha = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+  __m256i value = _mm256_add_epi16(_mm256_mullo_epi16(source, alpha),
+                                   _mm256_mullo_epi16(dest, inverse_alpha));
+  value = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+  value = _mm256_add_epi16(value, _mm256_srli_epi16(value, 8));
+  return _mm256_srli_epi16(value, 8);
+}
+
+BASE_PIXELS_TARGET_AVX2
+void BlendAVX2(uint32* dest, const uint32* source, uint32 count) {
+  __m256i zero = _mm256_setzero_si256();
+  uint32 i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m256i s =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));
+    __m256i low = BlendChannelsAVX2(_mm256_unpacklo_epi8(s, zero),
+                                    _mm256_unpacklo_epi8(d, zero));
+    __m256i high = BlendChannelsAVX2(_mm256_unpackhi_epi8(s, zero),
+                                     _mm256_unpackhi_epi8(d, zero));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm256_packus_epi16(low, high));
+  }
+
+  _mm256_zeroupper();
+  BlendSSE2(dest + i, source + i, count - i);
+}
+
+BASE_PIXELS_TARGET_AVX2
+void SwapRedBlueAVX2(uint32* dest, const uint32* source, uint32 count) {
+  // A single byte shuffle swaps bytes 0 and 2 of every pixel.
+  __m256i shuffle = _mm256_setr_epi8(
+      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5,
+      4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  uint32 i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m256i s =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm256_shuffle_epi8(s, shuffle));
+  }
+
+  _mm256_zeroupper();
+  SwapRedBlueSSE2(dest + i, source + i, count - i);
+}
+
+BASE_PIXELS_TARGET_AVX2
+__m256i PackRGB565AVX2(__m256i s) {
+  __m256i value = _mm256_or_si256(
+      _mm256_and_si256(_mm256_srli_epi32(s, 8), _mm256_set1_epi32(0xF800)),
+      _mm256_or_si256(
+          _mm256_and_si256(_mm256_srli_epi32(s, 5), _mm256_set1_epi32(0x07E0)),
+          _mm256_and_si256(_mm256_srli_epi32(s, 3),
+                           _mm256_set1_epi32(0x001F))));
+  return _mm256_sub_epi32(value, _mm256_set1_epi32(0x8000));
+}
+
+BASE_PIXELS_TARGET_AVX2
+void ToRGB565AVX2(uint16* dest, const uint32* source, uint32 count) {
+  __m256i bias = _mm256_set1_epi16(static_cast<int16>(0x8000));
+  uint32 i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    __m256i low = PackRGB565AVX2(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i)));
+    __m256i high = PackRGB565AVX2(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i + 8)));
+    // The pack interleaves 64 bit blocks of its inputs across lanes, which we
+    // restore with a cross lane permute.
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high),
+                                              _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm256_xor_si256(packed, bias));
+  }
+
+  _mm256_zeroupper();
+  ToRGB565SSE2(dest + i, source + i, count - i);
+}
+
+BASE_PIXELS_TARGET_AVX2
+void FromRGB565AVX2(uint32* dest, const uint16* source, uint32 count) {
+  uint32 i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m256i s = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)));
+    __m256i red =
+        _mm256_and_si256(_mm256_srli_epi32(s, 8), _mm256_set1_epi32(0xF8));
+    __m256i green =
+        _mm256_and_si256(_mm256_srli_epi32(s, 3), _mm256_set1_epi32(0xFC));
+    __m256i blue =
+        _mm256_and_si256(_mm256_slli_epi32(s, 3), _mm256_set1_epi32(0xF8));
+    red = _mm256_or_si256(red, _mm256_srli_epi32(red, 5));
+    green = _mm256_or_si256(green, _mm256_srli_epi32(green, 6));
+    blue = _mm256_or_si256(blue, _mm256_srli_epi32(blue, 5));
+    __m256i result = _mm256_or_si256(
+        _mm256_or_si256(_mm256_set1_epi32(0xFF000000),
+                        _mm256_slli_epi32(red, 16)),
+        _mm256_or_si256(_mm256_slli_epi32(green, 8), blue));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), result);
+  }
+
+  _mm256_zeroupper();
+  FromRGB565SSE2(dest + i, source + i, count - i);
+}
+
+// Returns true if the CPU and operating system both support AVX2.
+bool HasAVX2() {
+#if defined(_MSC_VER)
+  int registers[4];
+  __cpuid(registers, 0);
+  if (registers[0] < 7) {
+    return false;
+  }
+
+  // AVX state must be enabled by the OS (OSXSAVE plus XCR0 bits 1 and 2)
+  // before any AVX instruction can be used.
+  __cpuid(registers, 1);
+  bool has_osxsave = (registers[2] & (1 << 27)) != 0;
+  if (!has_osxsave || (_xgetbv(0) & 6) != 6) {
+    return false;
+  }
+
+  __cpuidex(registers, 7, 0);
+  return (registers[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif  // BASE_PIXELS_X86
+
+#if defined(BASE_PIXELS_NEON)
+
+// NEON kernels. Structured loads split pixels into planar channels, which
+// lets us operate on 8 or 16 pixels at a time without any shuffling.
+
+void FillNEON(uint32* dest, uint32 count, uint32 color) {
+  uint32x4_t value = vdupq_n_u32(color);
+  uint32 i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    vst1q_u32(dest + i, value);
+    vst1q_u32(dest + i + 4, value);
+  }
+
+  FillScalar(dest + i, count - i, color);
+}
+
+uint8x8_t BlendChannelNEON(uint8x8_t source, uint8x8_t dest, uint8x8_t alpha) {
+  uint16x8_t value = vmull_u8(source, alpha);
+  value = vmlal_u8(value, dest, vmvn_u8(alpha));
+  value = vaddq_u16(value, vdupq_n_u16(128));
+  value = vaddq_u16(value, vshrq_n_u16(value, 8));
+  return vshrn_n_u16(value, 8);
+}
+
+void BlendNEON(uint32* dest, const uint32* source, uint32 count) {
+  uint32 i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    uint8x8x4_t s = vld4_u8(reinterpret_cast<const uint8*>(source + i));
+    uint8x8x4_t d = vld4_u8(reinterpret_cast<const uint8*>(dest + i));
+    uint8x8_t alpha = s.val[3];
+    for (int channel = 0; channel < 4; channel++) {
+      d.val[channel] = BlendChannelNEON(s.val[channel], d.val[channel], alpha);
+    }
+    vst4_u8(reinterpret_cast<uint8*>(dest + i), d);
+  }
+
+  BlendScalar(dest + i, source + i, count - i);
+}
+
+void SwapRedBlueNEON(uint32* dest, const uint32* source, uint32 count) {
+  uint32 i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    uint8x16x4_t s = vld4q_u8(reinterpret_cast<const uint8*>(source + i));
+    uint8x16_t red = s.val[2];
+    s.val[2] = s.val[0];
+    s.val[0] = red;
+    vst4q_u8(reinterpret_cast<uint8*>(dest + i), s);
+  }
+
+  SwapRedBlueScalar(dest + i, source + i, count - i);
+}
+
+void ToRGB565NEON(uint16* dest, const uint32* source, uint32 count) {
+  uint32 i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    uint8x8x4_t s = vld4_u8(reinterpret_cast<const uint8*>(source + i));
+    uint16x8_t red = vandq_u16(vshll_n_u8(s.val[2], 8), vdupq_n_u16(0xF800));
+    uint16x8_t green =
+        vandq_u16(vshll_n_u8(s.val[1], 3), vdupq_n_u16(0x07E0));
+    uint16x8_t blue = vmovl_u8(vshr_n_u8(s.val[0], 3));
+    vst1q_u16(dest + i, vorrq_u16(vorrq_u16(red, green), blue));
+  }
+
+  ToRGB565Scalar(dest + i, source + i, count - i);
+}
+
+void FromRGB565NEON(uint32* dest, const uint16* source, uint32 count) {
+  uint32 i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    uint16x8_t s = vld1q_u16(source + i);
+    uint8x8x4_t d;
+    uint8x8_t red = vand_u8(vshrn_n_u16(s, 8), vdup_n_u8(0xF8));
+    uint8x8_t green = vand_u8(vshrn_n_u16(s, 3), vdup_n_u8(0xFC));
+    uint8x8_t blue = vand_u8(vmovn_u16(vshlq_n_u16(s, 3)), vdup_n_u8(0xF8));
+    d.val[0] = vorr_u8(blue, vshr_n_u8(blue, 5));
+    d.val[1] = vorr_u8(green, vshr_n_u8(green, 6));
+    d.val[2] = vorr_u8(red, vshr_n_u8(red, 5));
+    d.val[3] = vdup_n_u8(0xFF);
+    vst4_u8(reinterpret_cast<uint8*>(dest + i), d);
+  }
+
+  FromRGB565Scalar(dest + i, source + i, count - i);
+}
+
+#endif  // BASE_PIXELS_NEON
+
+const PixelKernels* GetPixelKernels(PixelKernelSet set) {
+  static const PixelKernels scalar_kernels = {
+      "scalar",       FillScalar,     BlendScalar, SwapRedBlueScalar,
+      ToRGB565Scalar, FromRGB565Scalar};
+
+  switch (set) {
+    case PixelKernelSetScalar:
+      return &scalar_kernels;
+
+#if defined(BASE_PIXELS_X86)
+    case PixelKernelSetSSE2: {
+      // SSE2 is part of the x64 baseline, and we assume it on 32 bit x86 as
+      // well since every CPU capable of running a supported OS provides it.
+      static const PixelKernels sse2_kernels = {
+          "sse2",       FillSSE2,     BlendSSE2, SwapRedBlueSSE2,
+          ToRGB565SSE2, FromRGB565SSE2};
+      return &sse2_kernels;
+    }
+
+    case PixelKernelSetAVX2: {
+      static const PixelKernels avx2_kernels = {
+          "avx2",       FillAVX2,     BlendAVX2, SwapRedBlueAVX2,
+          ToRGB565AVX2, FromRGB565AVX2};
+      static const bool has_avx2 = HasAVX2();
+      return has_avx2 ? &avx2_kernels : nullptr;
+    }
+#endif
+
+#if defined(BASE_PIXELS_NEON)
+    case PixelKernelSetNEON: {
+      static const PixelKernels neon_kernels = {
+          "neon",       FillNEON,     BlendNEON, SwapRedBlueNEON,
+          ToRGB565NEON, FromRGB565NEON};
+      return &neon_kernels;
+    }
+#endif
+
+    default:
+      return nullptr;
+  }
+}
+
+const PixelKernels& GetPixelKernels() {
+  static const PixelKernels* best_kernels = [] {
+    const PixelKernels* kernels = nullptr;
+    for (int32 set = PixelKernelSetCount - 1; set >= 0 && !kernels; set--) {
+      kernels = GetPixelKernels(static_cast<PixelKernelSet>(set));
+    }
+    return kernels;
+  }();
+
+  return *best_kernels;
+}
+
+void ClearPixels(const PixelBuffer& buffer, uint32 color) {
+  if (buffer.width == buffer.stride) {
+    // Contiguous buffers are cleared with a single span.
+    GetPixelKernels().fill(buffer.pixels, buffer.stride * buffer.height, color);
+    return;
+  }
+
+  FillRect(buffer, 0, 0, buffer.width, buffer.height, color);
+}
+
+void FillRect(const PixelBuffer& buffer, int32 x, int32 y, int32 width,
+              int32 height, uint32 color) {
+  int32 x0 = x < 0 ? 0 : x;
+  int32 y0 = y < 0 ? 0 : y;
+  int32 x1 = x + width > int32(buffer.width) ? int32(buffer.width) : x + width;
+  int32 y1 =
+      y + height > int32(buffer.height) ? int32(buffer.height) : y + height;
+
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+
+  const PixelKernels& kernels = GetPixelKernels();
+  for (int32 row = y0; row < y1; row++) {
+    kernels.fill(buffer.pixels + row * buffer.stride + x0, x1 - x0, color);
+  }
+}
+
+void BlendPixels(const PixelBuffer& dest, int32 x, int32 y,
+                 const PixelBuffer& source) {
+  int32 x0 = x < 0 ? 0 : x;
+  int32 y0 = y < 0 ? 0 : y;
+  int32 x1 = x + int32(source.width);
+  int32 y1 = y + int32(source.height);
+  x1 = x1 > int32(dest.width) ? int32(dest.width) : x1;
+  y1 = y1 > int32(dest.height) ? int32(dest.height) : y1;
+
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+
+  const PixelKernels& kernels = GetPixelKernels();
+  for (int32 row = y0; row < y1; row++) {
+    kernels.blend(dest.pixels + row * dest.stride + x0,
+                  source.pixels + (row - y) * source.stride + (x0 - x),
+                  x1 - x0);
+  }
+}
+
+void SwapRedBlue(const PixelBuffer& dest, const PixelBuffer& source) {
+  uint32 width = dest.width < source.width ? dest.width : source.width;
+  uint32 height = dest.height < source.height ? dest.height : source.height;
+
+  const PixelKernels& kernels = GetPixelKernels();
+  for (uint32 row = 0; row < height; row++) {
+    kernels.swap_red_blue(dest.pixels + row * dest.stride,
+                          source.pixels + row * source.stride, width);
+  }
+}
+
+void ConvertToRGB565(uint16* dest, uint32 dest_stride,
+                     const PixelBuffer& source) {
+  const PixelKernels& kernels = GetPixelKernels();
+  for (uint32 row = 0; row < source.height; row++) {
+    kernels.to_rgb565(dest + row * dest_stride,
+                      source.pixels + row * source.stride, source.width);
+  }
+}
+
+void ConvertFromRGB565(const PixelBuffer& dest, const uint16* source,
+                       uint32 source_stride) {
+  const PixelKernels& kernels = GetPixelKernels();
+  for (uint32 row = 0; row < dest.height; row++) {
+    kernels.from_rgb565(dest.pixels + row * dest.stride,
+                        source + row * source_stride, dest.width);
+  }
+}
+
+}  // namespace base
+
+#endif  // __BASE_PIXELS_H__
@@ -0,0 +1,895 @@
+/*
+//
+// Copyright (c) 1998-2019 Joe Bertolami. All Right Reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, CLUDG, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//   ARE DISCLAIMED.  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//   LIABLE FOR ANY DIRECT, DIRECT, CIDENTAL, SPECIAL, EXEMPLARY, OR
+//   CONSEQUENTIAL DAMAGES (CLUDG, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+//   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSESS TERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER  CONTRACT, STRICT
+//   LIABILITY, OR TORT (CLUDG NEGLIGENCE OR OTHERWISE) ARISG  ANY WAY  OF THE
+//   USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+//
+*/
+
+
+#ifndef __BASE_RASTER_H__
+#define __BASE_RASTER_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "base_pixels.h"
+
+namespace base {
+
+// The width and height of each rasterizer tile, in pixels. Tiles are the unit
+// of parallel work, and are sized so that a tile of the target fits
+// comfortably within a core's L1 or L2 cache.
+const uint32 kRasterTileSize = 64;
+
+// Coordinates are limited to a guard band of +/- kRasterGuardBand pixels, which
+// must exceed the largest target. Within it, triangle vertices snapped to sub
+// pixel precision keep every edge function product well inside 64 bits.
+// Triangles that reach beyond the guard band are clipped to it, and other
+// primitives are clamped to it, which leaves the pixels they cover unchanged.
+const float32 kRasterGuardBand = 65536.0f;
+
+// Runs batches of independent jobs across a fixed set of worker threads. Each
+// batch is split evenly between the workers up front, and workers that run
+// out of work steal from the tail of other workers' ranges. The calling
+// thread participates as worker zero.
+class JobPool {
+ public:
+  // Creates a pool with thread_count workers (including the calling thread),
+  // or one worker per hardware thread if thread_count is zero.
+  explicit JobPool(uint32 thread_count = 0);
+  JobPool(const JobPool& rhs) = delete;
+  ~JobPool();
+
+  // Runs job(index, worker) for every index in [0, count), and returns once
+  // every job has completed. Worker is in [0, GetWorkerCount()) and may be
+  // used to index per-worker scratch storage.
+  void Run(uint32 count, const ::std::function<void(uint32, uint32)>& job);
+  // Returns the number of workers, including the calling thread.
+  uint32 GetWorkerCount() const;
+  // Returns the number of jobs that were stolen during the most recent Run.
+  uint32 GetStealCount() const;
+
+ private:
+  // Each worker's pending jobs are a contiguous range, packed as
+  // (end << 32 | begin) so that the owner (popping from the front) and thieves
+  // (popping from the back) can update it with a single compare and swap. We
+  // pad each range to a cache line to avoid false sharing between workers.
+  typedef struct alignas(64) JobRange {
+    ::std::atomic<uint64> range;
+  } JobRange;
+
+  void WorkerMain(uint32 worker);
+  // Runs jobs until no worker has any remaining.
+  void Execute(uint32 worker);
+  bool PopJob(uint32 worker, uint32* index);
+  bool StealJob(uint32 victim, uint32* index);
+
+  ::std::vector<::std::thread> threads_;
+  ::std::unique_ptr<JobRange[]> ranges_;
+  uint32 worker_count_;
+  const ::std::function<void(uint32, uint32)>* job_;
+  ::std::atomic<uint32> remaining_jobs_;
+  ::std::atomic<uint32> steal_count_;
+
+  // Guards the fields below, which coordinate workers between batches.
+  ::std::mutex mutex_;
+  ::std::condition_variable wake_condition_;
+  ::std::condition_variable done_condition_;
+  uint64 generation_;
+  uint32 busy_workers_;
+  bool is_stopping_;
+};
+
+typedef struct RasterStats {
+  // The number of primitives submitted during the frame.
+  uint32 commands;
+  // The number of tiles that the target was divided into.
+  uint32 tiles;
+  // The total number of (tile, primitive) pairs after binning.
+  uint32 binned_commands;
+  // The number of tiles that were stolen by idle workers.
+  uint32 steals;
+  // The number of workers that rasterized the frame.
+  uint32 workers;
+} RasterStats;
+
+// A tile binned software rasterizer for machines without a GPU. Primitives
+// are recorded between Begin and End, binned into every tile that their
+// bounds overlap, and then rasterized tile by tile across a job pool. Each
+// tile draws its primitives in submission order, so the result is identical
+// to a single threaded rasterizer regardless of the number of workers.
+//
+// Coordinates are in pixels with the origin at the upper left corner of the
+// target, and pixel centers at half integer offsets. Colors are in the native
+// pixel format (see MakePixel), and are blended if their alpha is below 255.
+//
+// Typical usage draws into a window's software framebuffer:
+//
+//   rasterizer.Begin(window->GetPixelBuffer());
+//   rasterizer.DrawTriangle(...);
+//   rasterizer.End();
+//   window->PresentPixels();
+class Rasterizer {
+ public:
+  // Creates a rasterizer with thread_count workers, or one per hardware
+  // thread if thread_count is zero.
+  explicit Rasterizer(uint32 thread_count = 0);
+  Rasterizer(const Rasterizer& rhs) = delete;
+
+  // Begins recording a frame that will be drawn into target.
+  void Begin(const PixelBuffer& target);
+  // Fills the entire target with color.
+  void Clear(uint32 color);
+  // Fills a triangle. Vertices may be supplied in either winding.
+  void DrawTriangle(float32 x0, float32 y0, float32 x1, float32 y1,
+                    float32 x2, float32 y2, uint32 color);
+  // Fills an axis aligned rectangle.
+  void DrawRect(float32 x, float32 y, float32 width, float32 height,
+                uint32 color);
+  // Draws a single pixel wide line.
+  void DrawLine(float32 x0, float32 y0, float32 x1, float32 y1, uint32 color);
+  // Draws an axis aligned rectangle mapped with the (u0, v0) to (u1, v1)
+  // region of texture, using nearest sampling and the texture's alpha. The
+  // texture must remain valid until End returns.
+  void DrawTexturedQuad(float32 x, float32 y, float32 width, float32 height,
+                        const PixelBuffer& texture, float32 u0 = 0,
+                        float32 v0 = 0, float32 u1 = 1, float32 v1 = 1);
+  // Rasterizes every recorded primitive into the target and returns once the
+  // frame is complete.
+  void End();
+  // Returns statistics for the most recently completed frame.
+  const RasterStats& GetStats() const;
+
+ private:
+  enum RasterCommandType : uint8 {
+    RasterCommandClear,
+    RasterCommandTriangle,
+    RasterCommandRect,
+    RasterCommandLine,
+    RasterCommandTexturedQuad,
+  };
+
+  typedef struct RasterCommand {
+    RasterCommandType type;
+    uint32 color;
+    // The meaning of each parameter depends upon the command type.
+    float32 params[8];
+    PixelBuffer texture;
+  } RasterCommand;
+
+  // Per worker storage, used to stage spans before they are blended.
+  typedef struct RasterScratch {
+    ::std::vector<uint32> span;
+  } RasterScratch;
+
+  // Records command and adds it to every tile that the bounds overlap.
+  void AddCommand(const RasterCommand& command, float32 min_x, float32 min_y,
+                  float32 max_x, float32 max_y);
+  // Records a triangle whose vertices lie within the guard band.
+  void AddTriangle(const float32* vertices, uint32 color);
+  // Returns true if a line command may cover any pixel of a tile.
+  bool LineCrossesTile(const RasterCommand& command, int32 tile_x,
+                       int32 tile_y);
+  // Rasterizes every command binned to a single tile.
+  void DrawTile(uint32 tile, uint32 worker);
+  // Writes a solid span, blending if the color is translucent. The scratch
+  // span must hold the color when blending.
+  void FillSpan(uint32* dest, uint32 count, uint32 color,
+                RasterScratch* scratch);
+
+  void DrawTriangleTile(const RasterCommand& command, int32 tile_x0,
+                        int32 tile_y0, int32 tile_x1, int32 tile_y1,
+                        RasterScratch* scratch);
+  void DrawRectTile(const RasterCommand& command, int32 tile_x0,
+                    int32 tile_y0, int32 tile_x1, int32 tile_y1,
+                    RasterScratch* scratch);
+  void DrawLineTile(const RasterCommand& command, int32 tile_x0,
+                    int32 tile_y0, int32 tile_x1, int32 tile_y1);
+  void DrawTexturedQuadTile(const RasterCommand& command, int32 tile_x0,
+                            int32 tile_y0, int32 tile_x1, int32 tile_y1,
+                            RasterScratch* scratch);
+
+  JobPool pool_;
+  PixelBuffer target_;
+  uint32 tiles_x_;
+  uint32 tiles_y_;
+  ::std::vector<RasterCommand> commands_;
+  // The indices of the commands that overlap each tile, in submission order.
+  // Bins are cleared rather than released between frames.
+  ::std::vector<::std::vector<uint32>> bins_;
+  ::std::vector<RasterScratch> scratch_;
+  RasterStats stats_;
+};
+
+/* Implementation */
+
+JobPool::JobPool(uint32 thread_count)
+    : worker_count_(thread_count),
+      job_(nullptr),
+      remaining_jobs_(0),
+      steal_count_(0),
+      generation_(0),
+      busy_workers_(0),
+      is_stopping_(false) {
+  if (!worker_count_) {
+    worker_count_ = ::std::thread::hardware_concurrency();
+    worker_count_ = worker_count_ ? worker_count_ : 1;
+  }
+
+  ranges_.reset(new JobRange[worker_count_]);
+  for (uint32 i = 0; i < worker_count_; i++) {
+    ranges_[i].range = 0;
+  }
+
+  // Worker zero is the thread that calls Run, so we only spawn the others.
+  for (uint32 i = 1; i < worker_count_; i++) {
+    threads_.emplace_back(&JobPool::WorkerMain, this, i);
+  }
+}
+
+JobPool::~JobPool() {
+  {
+    ::std::lock_guard<::std::mutex> lock(mutex_);
+    is_stopping_ = true;
+  }
+
+  wake_condition_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+uint32 JobPool::GetWorkerCount() const { return worker_count_; }
+
+uint32 JobPool::GetStealCount() const { return steal_count_; }
+
+void JobPool::Run(uint32 count,
+                  const ::std::function<void(uint32, uint32)>& job) {
+  if (!count) {
+    return;
+  }
+
+  job_ = &job;
+  steal_count_ = 0;
+  remaining_jobs_ = count;
+
+  for (uint32 i = 0; i < worker_count_; i++) {
+    uint64 begin = uint64(count) * i / worker_count_;
+    uint64 end = uint64(count) * (i + 1) / worker_count_;
+    ranges_[i].range.store((end << 32) | begin, ::std::memory_order_relaxed);
+  }
+
+  {
+    ::std::lock_guard<::std::mutex> lock(mutex_);
+    generation_++;
+    busy_workers_ = worker_count_ - 1;
+  }
+
+  wake_condition_.notify_all();
+  Execute(0);
+
+  // We wait for every worker to go idle, not just for the jobs to finish, so
+  // that no straggler can touch the ranges once the next batch begins.
+  ::std::unique_lock<::std::mutex> lock(mutex_);
+  done_condition_.wait(lock, [this] {
+    return !remaining_jobs_.load(::std::memory_order_acquire) &&
+           !busy_workers_;
+  });
+  job_ = nullptr;
+}
+
+void JobPool::WorkerMain(uint32 worker) {
+  uint64 generation = 0;
+
+  while (true) {
+    {
+      ::std::unique_lock<::std::mutex> lock(mutex_);
+      wake_condition_.wait(lock, [&] {
+        return is_stopping_ || generation != generation_;
+      });
+
+      if (is_stopping_) {
+        return;
+      }
+
+      generation = generation_;
+    }
+
+    Execute(worker);
+
+    {
+      ::std::lock_guard<::std::mutex> lock(mutex_);
+      busy_workers_--;
+    }
+    done_condition_.notify_all();
+  }
+}
+
+void JobPool::Execute(uint32 worker) {
+  uint32 index = 0;
+
+  while (true) {
+    bool found = PopJob(worker, &index);
+
+    // Once our own range is empty we visit the other workers in turn,
+    // starting with our neighbor so that thieves spread out.
+    for (uint32 i = 1; !found && i < worker_count_; i++) {
+      found = StealJob((worker + i) % worker_count_, &index);
+      if (found) {
+        steal_count_.fetch_add(1, ::std::memory_order_relaxed);
+      }
+    }
+
+    if (!found) {
+      return;
+    }
+
+    (*job_)(index, worker);
+    remaining_jobs_.fetch_sub(1, ::std::memory_order_acq_rel);
+  }
+}
+
+bool JobPool::PopJob(uint32 worker, uint32* index) {
+  auto& range = ranges_[worker].range;
+  uint64 value = range.load(::std::memory_order_acquire);
+
+  while (true) {
+    uint32 begin = static_cast<uint32>(value);
+    uint32 end = static_cast<uint32>(value >> 32);
+
+    if (begin >= end) {
+      return false;
+    }
+
+    uint64 next = (uint64(end) << 32) | (begin + 1);
+    if (range.compare_exchange_weak(value, next, ::std::memory_order_acq_rel)) {
+      *index = begin;
+      return true;
+    }
+  }
+}
+
+bool JobPool::StealJob(uint32 victim, uint32* index) {
+  auto& range = ranges_[victim].range;
+  uint64 value = range.load(::std::memory_order_acquire);
+
+  while (true) {
+    uint32 begin = static_cast<uint32>(value);
+    uint32 end = static_cast<uint32>(value >> 32);
+
+    if (begin >= end) {
+      return false;
+    }
+
+    uint64 next = (uint64(end - 1) << 32) | begin;
+    if (range.compare_exchange_weak(value, next, ::std::memory_order_acq_rel)) {
+      *index = end - 1;
+      return true;
+    }
+  }
+}
+
+Rasterizer::Rasterizer(uint32 thread_count)
+    : pool_(thread_count), target_(), tiles_x_(0), tiles_y_(0), stats_() {
+  scratch_.resize(pool_.GetWorkerCount());
+  for (auto& scratch : scratch_) {
+    scratch.span.resize(kRasterTileSize);
+  }
+}
+
+const RasterStats& Rasterizer::GetStats() const { return stats_; }
+
+void Rasterizer::Begin(const PixelBuffer& target) {
+  target_ = target;
+  tiles_x_ = (target.width + kRasterTileSize - 1) / kRasterTileSize;
+  tiles_y_ = (target.height + kRasterTileSize - 1) / kRasterTileSize;
+
+  commands_.clear();
+  bins_.resize(tiles_x_ * tiles_y_);
+  for (auto& bin : bins_) {
+    bin.clear();
+  }
+
+  stats_ = RasterStats();
+}
+
+// Returns value limited to the guard band. NaN is mapped to its lower edge,
+// so that the result is always safe to convert to an integer.
+float32 ClampToGuardBand(float32 value) {
+  if (!(value > -kRasterGuardBand)) {
+    return -kRasterGuardBand;
+  }
+  return value < kRasterGuardBand ? value : kRasterGuardBand;
+}
+
+void Rasterizer::AddCommand(const RasterCommand& command, float32 min_x,
+                            float32 min_y, float32 max_x, float32 max_y) {
+  min_x = ClampToGuardBand(min_x);
+  min_y = ClampToGuardBand(min_y);
+  max_x = ClampToGuardBand(max_x);
+  max_y = ClampToGuardBand(max_y);
+
+  if (!target_.pixels || max_x < 0 || max_y < 0 ||
+      min_x >= float32(target_.width) || min_y >= float32(target_.height)) {
+    return;
+  }
+
+  int32 tile_x0 = min_x < 0 ? 0 : int32(min_x) / int32(kRasterTileSize);
+  int32 tile_y0 = min_y < 0 ? 0 : int32(min_y) / int32(kRasterTileSize);
+  int32 tile_x1 = int32(max_x) / int32(kRasterTileSize);
+  int32 tile_y1 = int32(max_y) / int32(kRasterTileSize);
+  tile_x1 = tile_x1 >= int32(tiles_x_) ? tiles_x_ - 1 : tile_x1;
+  tile_y1 = tile_y1 >= int32(tiles_y_) ? tiles_y_ - 1 : tile_y1;
+
+  uint32 index = static_cast<uint32>(commands_.size());
+  commands_.push_back(command);
+
+  for (int32 y = tile_y0; y <= tile_y1; y++) {
+    for (int32 x = tile_x0; x <= tile_x1; x++) {
+      if (RasterCommandLine == command.type && !LineCrossesTile(command, x, y)) {
+        continue;
+      }
+      bins_[y * tiles_x_ + x].push_back(index);
+      stats_.binned_commands++;
+    }
+  }
+}
+
+bool Rasterizer::LineCrossesTile(const RasterCommand& command, int32 tile_x,
+                                 int32 tile_y) {
+  // Long diagonal lines have bounds that cover many tiles that they never
+  // touch. We reject a tile if all four of its corners (padded by a pixel to
+  // stay conservative) lie strictly on the same side of the line.
+  float32 x0 = command.params[0], y0 = command.params[1];
+  float32 dx = command.params[2] - x0, dy = command.params[3] - y0;
+  float32 left = float32(tile_x * kRasterTileSize) - 1;
+  float32 top = float32(tile_y * kRasterTileSize) - 1;
+  float32 right = left + kRasterTileSize + 2;
+  float32 bottom = top + kRasterTileSize + 2;
+
+  float32 corners[4] = {
+      dx * (top - y0) - dy * (left - x0), dx * (top - y0) - dy * (right - x0),
+      dx * (bottom - y0) - dy * (left - x0),
+      dx * (bottom - y0) - dy * (right - x0)};
+
+  bool all_positive = true, all_negative = true;
+  for (float32 corner : corners) {
+    all_positive = all_positive && corner > 0;
+    all_negative = all_negative && corner < 0;
+  }
+
+  return !all_positive && !all_negative;
+}
+
+void Rasterizer::Clear(uint32 color) {
+  RasterCommand command = {RasterCommandClear, color, {}, {}};
+  AddCommand(command, 0, 0, float32(target_.width), float32(target_.height));
+}
+
+// Clips the polygon of count (x, y) pairs in input against the half plane
+// sign * coordinate <= kRasterGuardBand, where coordinate is x if axis is
+// zero and y otherwise. Writes the result to output and returns its count,
+// which exceeds count by at most one.
+uint32 ClipToGuardBand(const float32* input, uint32 count, uint32 axis,
+                       float32 sign, float32* output) {
+  uint32 output_count = 0;
+  for (uint32 i = 0; i < count; i++) {
+    const float32* current = input + i * 2;
+    const float32* next = input + ((i + 1) % count) * 2;
+    float64 current_distance = sign * current[axis] - kRasterGuardBand;
+    float64 next_distance = sign * next[axis] - kRasterGuardBand;
+
+    if (current_distance <= 0) {
+      output[output_count * 2] = current[0];
+      output[output_count * 2 + 1] = current[1];
+      output_count++;
+    }
+
+    // Intersections are computed in double precision, as the vertex beyond
+    // the guard band may be arbitrarily far away.
+    if ((current_distance <= 0) != (next_distance <= 0)) {
+      float64 t = current_distance / (current_distance - next_distance);
+      for (uint32 j = 0; j < 2; j++) {
+        output[output_count * 2 + j] =
+            float32(current[j] + (float64(next[j]) - current[j]) * t);
+      }
+      output[output_count * 2 + axis] = sign * kRasterGuardBand;
+      output_count++;
+    }
+  }
+  return output_count;
+}
+
+void Rasterizer::DrawTriangle(float32 x0, float32 y0, float32 x1, float32 y1,
+                              float32 x2, float32 y2, uint32 color) {
+  // Clipping against each of the four guard band edges adds at most one
+  // vertex, so the clipped polygon has at most seven.
+  float32 polygon[2][14] = {{x0, y0, x1, y1, x2, y2}};
+  uint32 count = 3;
+  bool is_inside = true;
+
+  for (uint32 i = 0; i < 6; i++) {
+    if (!::std::isfinite(polygon[0][i])) {
+      return;
+    }
+    is_inside = is_inside && fabsf(polygon[0][i]) <= kRasterGuardBand;
+  }
+
+  if (is_inside) {
+    AddTriangle(polygon[0], color);
+    return;
+  }
+
+  uint32 source = 0;
+  for (uint32 plane = 0; plane < 4 && count >= 3; plane++) {
+    count = ClipToGuardBand(polygon[source], count, plane & 1,
+                            (plane & 2) ? -1.0f : 1.0f, polygon[source ^ 1]);
+    source ^= 1;
+  }
+
+  // The clipped polygon is convex, so we draw it as a fan. The top-left fill
+  // rule ensures that the interior edges of the fan draw each pixel once.
+  for (uint32 i = 1; i + 1 < count; i++) {
+    float32 vertices[6] = {polygon[source][0],         polygon[source][1],
+                           polygon[source][i * 2],     polygon[source][i * 2 + 1],
+                           polygon[source][i * 2 + 2], polygon[source][i * 2 + 3]};
+    AddTriangle(vertices, color);
+  }
+}
+
+void Rasterizer::AddTriangle(const float32* vertices, uint32 color) {
+  RasterCommand command = {RasterCommandTriangle,
+                           color,
+                           {vertices[0], vertices[1], vertices[2], vertices[3],
+                            vertices[4], vertices[5]},
+                           {}};
+  AddCommand(command,
+             ::std::min(vertices[0], ::std::min(vertices[2], vertices[4])),
+             ::std::min(vertices[1], ::std::min(vertices[3], vertices[5])),
+             ::std::max(vertices[0], ::std::max(vertices[2], vertices[4])),
+             ::std::max(vertices[1], ::std::max(vertices[3], vertices[5])));
+}
+
+void Rasterizer::DrawRect(float32 x, float32 y, float32 width, float32 height,
+                          uint32 color) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+
+  RasterCommand command = {RasterCommandRect, color, {x, y, width, height}, {}};
+  AddCommand(command, x, y, x + width, y + height);
+}
+
+void Rasterizer::DrawLine(float32 x0, float32 y0, float32 x1, float32 y1,
+                          uint32 color) {
+  RasterCommand command = {RasterCommandLine, color, {x0, y0, x1, y1}, {}};
+  AddCommand(command, ::std::min(x0, x1), ::std::min(y0, y1),
+             ::std::max(x0, x1), ::std::max(y0, y1));
+}
+
+void Rasterizer::DrawTexturedQuad(float32 x, float32 y, float32 width,
+                                  float32 height, const PixelBuffer& texture,
+                                  float32 u0, float32 v0, float32 u1,
+                                  float32 v1) {
+  if (width <= 0 || height <= 0 || !texture.pixels) {
+    return;
+  }
+
+  RasterCommand command = {RasterCommandTexturedQuad,
+                           0,
+                           {x, y, width, height, u0, v0, u1, v1},
+                           texture};
+  AddCommand(command, x, y, x + width, y + height);
+}
+
+void Rasterizer::End() {
+  stats_.commands = static_cast<uint32>(commands_.size());
+  stats_.tiles = tiles_x_ * tiles_y_;
+  stats_.workers = pool_.GetWorkerCount();
+
+  if (commands_.empty()) {
+    return;
+  }
+
+  pool_.Run(tiles_x_ * tiles_y_,
+            [this](uint32 tile, uint32 worker) { DrawTile(tile, worker); });
+  stats_.steals = pool_.GetStealCount();
+}
+
+void Rasterizer::DrawTile(uint32 tile, uint32 worker) {
+  int32 tile_x0 = (tile % tiles_x_) * kRasterTileSize;
+  int32 tile_y0 = (tile / tiles_x_) * kRasterTileSize;
+  int32 tile_x1 = ::std::min(tile_x0 + int32(kRasterTileSize),
+                             int32(target_.width));
+  int32 tile_y1 = ::std::min(tile_y0 + int32(kRasterTileSize),
+                             int32(target_.height));
+  RasterScratch* scratch = &scratch_[worker];
+
+  for (uint32 index : bins_[tile]) {
+    const RasterCommand& command = commands_[index];
+
+    // Translucent solid spans are blended from a scratch span of the color,
+    // which we fill once per command rather than once per span.
+    if ((command.color >> 24) != 0xFF) {
+      GetPixelKernels().fill(scratch->span.data(), kRasterTileSize,
+                             command.color);
+    }
+
+    switch (command.type) {
+      case RasterCommandClear: {
+        for (int32 y = tile_y0; y < tile_y1; y++) {
+          GetPixelKernels().fill(target_.pixels + y * target_.stride + tile_x0,
+                                 tile_x1 - tile_x0, command.color);
+        }
+      } break;
+      case RasterCommandTriangle:
+        DrawTriangleTile(command, tile_x0, tile_y0, tile_x1, tile_y1, scratch);
+        break;
+      case RasterCommandRect:
+        DrawRectTile(command, tile_x0, tile_y0, tile_x1, tile_y1, scratch);
+        break;
+      case RasterCommandLine:
+        DrawLineTile(command, tile_x0, tile_y0, tile_x1, tile_y1);
+        break;
+      case RasterCommandTexturedQuad:
+        DrawTexturedQuadTile(command, tile_x0, tile_y0, tile_x1, tile_y1,
+                             scratch);
+        break;
+    }
+  }
+}
+
+void Rasterizer::FillSpan(uint32* dest, uint32 count, uint32 color,
+                          RasterScratch* scratch) {
+  if ((color >> 24) == 0xFF) {
+    GetPixelKernels().fill(dest, count, color);
+    return;
+  }
+
+  // Spans never exceed a tile, and DrawTile has already filled the scratch
+  // span with the color.
+  GetPixelKernels().blend(dest, scratch->span.data(), count);
+}
+
+// Returns numerator / denominator rounded towards negative infinity. The
+// denominator must be positive.
+int64 FloorDivide(int64 numerator, int64 denominator) {
+  int64 quotient = numerator / denominator;
+  return (numerator % denominator < 0) ? quotient - 1 : quotient;
+}
+
+void Rasterizer::DrawTriangleTile(const RasterCommand& command, int32 tile_x0,
+                                  int32 tile_y0, int32 tile_x1, int32 tile_y1,
+                                  RasterScratch* scratch) {
+  // Vertices are snapped to 8 bits of sub-pixel precision. Edge functions are
+  // evaluated in 64 bit integers, which keeps rasterization exact and ensures
+  // that tiles agree with one another along shared edges. DrawTriangle has
+  // clipped the vertices to the guard band, so these cannot overflow.
+  const int64 kSubPixel = 256;
+  int64 x[3], y[3];
+  for (int32 i = 0; i < 3; i++) {
+    x[i] = int64(floorf(command.params[i * 2] * kSubPixel + 0.5f));
+    y[i] = int64(floorf(command.params[i * 2 + 1] * kSubPixel + 0.5f));
+  }
+
+  int64 area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+  if (!area) {
+    return;
+  }
+
+  // Normalize the winding so that interior points have positive edge values.
+  if (area < 0) {
+    ::std::swap(x[1], x[2]);
+    ::std::swap(y[1], y[2]);
+  }
+
+  // Restrict the scan to the portion of the tile covered by the bounds of the
+  // triangle.
+  int64 min_x = ::std::min(x[0], ::std::min(x[1], x[2]));
+  int64 min_y = ::std::min(y[0], ::std::min(y[1], y[2]));
+  int64 max_x = ::std::max(x[0], ::std::max(x[1], x[2]));
+  int64 max_y = ::std::max(y[0], ::std::max(y[1], y[2]));
+  int32 x0 = int32(::std::max<int64>(tile_x0, min_x / kSubPixel));
+  int32 y0 = int32(::std::max<int64>(tile_y0, min_y / kSubPixel));
+  int32 x1 = int32(::std::min<int64>(tile_x1, max_x / kSubPixel + 1));
+  int32 y1 = int32(::std::min<int64>(tile_y1, max_y / kSubPixel + 1));
+
+  int64 edge_dx[3], edge_dy[3], edge_row[3];
+  int64 sample_x = int64(x0) * kSubPixel + kSubPixel / 2;
+  int64 sample_y = int64(y0) * kSubPixel + kSubPixel / 2;
+
+  for (int32 i = 0; i < 3; i++) {
+    int32 j = (i + 1) % 3;
+    edge_dx[i] = x[j] - x[i];
+    edge_dy[i] = y[j] - y[i];
+
+    // Apply the top-left fill rule: pixels centered exactly on an edge are
+    // only drawn for top and left edges, so that triangles sharing an edge
+    // never draw a pixel twice.
+    bool is_top_left = (edge_dy[i] == 0 && edge_dx[i] > 0) || edge_dy[i] < 0;
+    edge_row[i] = edge_dx[i] * (sample_y - y[i]) -
+                  edge_dy[i] * (sample_x - x[i]) - (is_top_left ? 0 : 1);
+  }
+
+  for (int32 row = y0; row < y1; row++) {
+    // Each edge function decreases by edge_dy per pixel step in x, so we can
+    // solve for the exact span of columns where all three are non-negative,
+    // rather than testing every pixel in the row.
+    int64 span_begin = 0;
+    int64 span_end = x1 - x0;
+
+    for (int32 i = 0; i < 3; i++) {
+      int64 step = edge_dy[i] * kSubPixel;
+
+      if (step > 0) {
+        span_end = ::std::min(span_end, FloorDivide(edge_row[i], step) + 1);
+      } else if (step < 0) {
+        span_begin = ::std::max(span_begin, -FloorDivide(edge_row[i], -step));
+      } else if (edge_row[i] < 0) {
+        span_end = 0;
+      }
+    }
+
+    if (span_begin < span_end) {
+      FillSpan(target_.pixels + row * target_.stride + x0 + span_begin,
+               uint32(span_end - span_begin), command.color, scratch);
+    }
+
+    for (int32 i = 0; i < 3; i++) {
+      edge_row[i] += edge_dx[i] * kSubPixel;
+    }
+  }
+}
+
+void Rasterizer::DrawRectTile(const RasterCommand& command, int32 tile_x0,
+                              int32 tile_y0, int32 tile_x1, int32 tile_y1,
+                              RasterScratch* scratch) {
+  // A pixel is covered if its center lies within the rectangle.
+  float32 right = command.params[0] + command.params[2];
+  float32 bottom = command.params[1] + command.params[3];
+  int32 x0 = ::std::max(
+      tile_x0, int32(ceilf(ClampToGuardBand(command.params[0]) - 0.5f)));
+  int32 y0 = ::std::max(
+      tile_y0, int32(ceilf(ClampToGuardBand(command.params[1]) - 0.5f)));
+  int32 x1 = ::std::min(tile_x1, int32(ceilf(ClampToGuardBand(right) - 0.5f)));
+  int32 y1 = ::std::min(tile_y1, int32(ceilf(ClampToGuardBand(bottom) - 0.5f)));
+
+  for (int32 row = y0; row < y1 && x0 < x1; row++) {
+    FillSpan(target_.pixels + row * target_.stride + x0, x1 - x0,
+             command.color, scratch);
+  }
+}
+
+void Rasterizer::DrawLineTile(const RasterCommand& command, int32 tile_x0,
+                              int32 tile_y0, int32 tile_x1, int32 tile_y1) {
+  float32 x0 = command.params[0], y0 = command.params[1];
+  float32 x1 = command.params[2], y1 = command.params[3];
+  bool is_steep = fabsf(y1 - y0) > fabsf(x1 - x0);
+
+  // We step along the major axis and derive the minor coordinate from the
+  // line's global equation, rather than accumulating an error term, so that
+  // every tile produces exactly the pixels it would in a single pass.
+  if (is_steep) {
+    ::std::swap(x0, y0);
+    ::std::swap(x1, y1);
+    ::std::swap(tile_x0, tile_y0);
+    ::std::swap(tile_x1, tile_y1);
+  }
+
+  if (x0 > x1) {
+    ::std::swap(x0, x1);
+    ::std::swap(y0, y1);
+  }
+
+  // The minor coordinate is range checked before it is converted, as it may
+  // lie far beyond the guard band for points outside of the tile.
+  float32 slope = (x1 > x0) ? (y1 - y0) / (x1 - x0) : 0;
+  int32 major0 = ::std::max(tile_x0, int32(floorf(ClampToGuardBand(x0))));
+  int32 major1 = ::std::min(tile_x1 - 1, int32(floorf(ClampToGuardBand(x1))));
+  uint32 color = command.color;
+  bool is_opaque = (color >> 24) == 0xFF;
+
+  for (int32 major = major0; major <= major1; major++) {
+    float32 minor_position = floorf(y0 + (major + 0.5f - x0) * slope);
+
+    if (!(minor_position >= tile_y0 && minor_position < tile_y1)) {
+      continue;
+    }
+
+    int32 minor = int32(minor_position);
+
+    uint32* pixel = is_steep
+                        ? target_.pixels + major * target_.stride + minor
+                        : target_.pixels + minor * target_.stride + major;
+
+    if (is_opaque) {
+      *pixel = color;
+    } else {
+      GetPixelKernels().blend(pixel, &color, 1);
+    }
+  }
+}
+
+void Rasterizer::DrawTexturedQuadTile(const RasterCommand& command,
+                                      int32 tile_x0, int32 tile_y0,
+                                      int32 tile_x1, int32 tile_y1,
+                                      RasterScratch* scratch) {
+  float32 quad_x = command.params[0], quad_y = command.params[1];
+  float32 quad_width = command.params[2], quad_height = command.params[3];
+  float32 u0 = command.params[4], v0 = command.params[5];
+  float32 u1 = command.params[6], v1 = command.params[7];
+  const PixelBuffer& texture = command.texture;
+
+  float32 right = ClampToGuardBand(quad_x + quad_width);
+  float32 bottom = ClampToGuardBand(quad_y + quad_height);
+  int32 x0 = ::std::max(tile_x0, int32(ceilf(ClampToGuardBand(quad_x) - 0.5f)));
+  int32 y0 = ::std::max(tile_y0, int32(ceilf(ClampToGuardBand(quad_y) - 0.5f)));
+  int32 x1 = ::std::min(tile_x1, int32(ceilf(right - 0.5f)));
+  int32 y1 = ::std::min(tile_y1, int32(ceilf(bottom - 0.5f)));
+
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+
+  // Texel coordinates are stepped in 16.16 fixed point across each row.
+  float32 texels_per_pixel_x = (u1 - u0) * texture.width / quad_width;
+  float32 texels_per_pixel_y = (v1 - v0) * texture.height / quad_height;
+  int64 step_u = int64(texels_per_pixel_x * 65536.0f);
+  int64 start_u =
+      int64((u0 * texture.width + (x0 + 0.5f - quad_x) * texels_per_pixel_x) *
+            65536.0f);
+  int32 max_u = int32(texture.width) - 1;
+  int32 max_v = int32(texture.height) - 1;
+
+  for (int32 row = y0; row < y1; row++) {
+    int32 v = int32(floorf(v0 * texture.height +
+                           (row + 0.5f - quad_y) * texels_per_pixel_y));
+    v = ::std::min(::std::max(v, 0), max_v);
+    const uint32* texels = texture.pixels + v * texture.stride;
+    int64 u = start_u;
+
+    for (int32 column = x0; column < x1; column++) {
+      int32 texel = ::std::min(::std::max(int32(u >> 16), 0), max_u);
+      scratch->span[column - x0] = texels[texel];
+      u += step_u;
+    }
+
+    GetPixelKernels().blend(target_.pixels + row * target_.stride + x0,
+                            scratch->span.data(), x1 - x0);
+  }
+}
+
+}  // namespace base
+
+#endif  // __BASE_RASTER_H__
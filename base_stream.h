@@ -0,0 +1,753 @@
+/*
+//
+// Copyright (c) 1998-2019 Joe Bertolami. All Right Reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, CLUDG, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//   ARE DISCLAIMED.  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//   LIABLE FOR ANY DIRECT, DIRECT, CIDENTAL, SPECIAL, EXEMPLARY, OR
+//   CONSEQUENTIAL DAMAGES (CLUDG, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+//   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSESS TERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER  CONTRACT, STRICT
+//   LIABILITY, OR TORT (CLUDG NEGLIGENCE OR OTHERWISE) ARISG  ANY WAY  OF THE
+//   USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+//
+*/
+
+
+
+#ifndef __BASE_STREAM_H__
+#define __BASE_STREAM_H__
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "base_window.h"
+
+namespace base {
+
+// Streams a window's software framebuffer to a viewer on the same machine.
+// Each frame is split into tiles, and only tiles whose hash differs from the
+// previously sent frame are run length encoded and written to the viewer.
+// Input events sent by the viewer are posted to the window and returned by
+// its next Update.
+//
+// The transport is a local named pipe (\\.\pipe\<name>). All messages are
+// little endian:
+//
+//   frame: StreamFrameHeader, then tile_count x (StreamTileHeader, data)
+//   input: StreamInputMessage (viewer to server)
+//
+// Mouse move and button messages carry target coordinates in pixels of the
+// most recently received frame. The server converts them to the same unit
+// coordinates (-1...1, positive y is up) that the window reports for local
+// mouse input, and drops them if no frame has been sent. Other target
+// coordinates are forwarded unchanged.
+//
+// Tile data is a sequence of packets, each beginning with a uint16 control
+// word. If the high bit is set, the low 15 bits are a repeat count for the
+// single uint32 pixel that follows. Otherwise the control word is the number
+// of literal uint32 pixels that follow. Tiles are encoded row by row.
+
+// The width and height of each stream tile, in pixels.
+const uint32 kStreamTileSize = 64;
+// The maximum number of pixels in a single run or literal packet.
+const uint32 kStreamMaxPacketLength = 0x7FFF;
+// The control word bit that marks a run packet.
+const uint16 kStreamRunFlag = 0x8000;
+// Message identifiers.
+const uint32 kStreamFrameMagic = 0x42465742;  // 'BWFB'
+const uint32 kStreamInputMagic = 0x4E495742;  // 'BWIN'
+// Size of the pipe's kernel buffer in each direction.
+const uint32 kStreamPipeBufferSize = 1024 * 1024;
+
+typedef struct StreamFrameHeader {
+  uint32 magic;
+  // Incremented for every frame that is sent.
+  uint32 frame_index;
+  // The dimensions of the framebuffer. The viewer resets its copy of the
+  // frame (to black) when these change, and the server resends every tile.
+  uint32 width;
+  uint32 height;
+  // The number of tiles that follow the header.
+  uint32 tile_count;
+  // The number of bytes that follow the header.
+  uint32 payload_size;
+} StreamFrameHeader;
+
+typedef struct StreamTileHeader {
+  // The column and row of the tile, in tiles.
+  uint16 tile_x;
+  uint16 tile_y;
+  // The number of bytes of encoded tile data that follow.
+  uint32 encoded_size;
+} StreamTileHeader;
+
+typedef struct StreamInputMessage {
+  uint32 magic;
+  uint8 input_type;
+  uint8 is_on;
+  uint16 reserved;
+  uint64 switch_index;
+  uint64 switch_extension;
+  float32 target_x;
+  float32 target_y;
+} StreamInputMessage;
+
+static_assert(sizeof(StreamFrameHeader) == 24, "Unexpected header padding.");
+static_assert(sizeof(StreamTileHeader) == 8, "Unexpected header padding.");
+static_assert(sizeof(StreamInputMessage) == 32, "Unexpected message padding.");
+
+typedef struct StreamStats {
+  // Frames written to the viewer, and frames skipped because the viewer had
+  // not yet consumed the previous frame.
+  uint64 frames_sent;
+  uint64 frames_dropped;
+  // The number of changed tiles sent, and the total bytes sent (including
+  // headers).
+  uint64 tiles_sent;
+  uint64 bytes_sent;
+  // The number of bytes the sent tiles would have occupied without encoding.
+  uint64 raw_bytes;
+  // The size and tile count of the most recent frame.
+  uint32 last_frame_bytes;
+  uint32 last_frame_tiles;
+  // The number of input events exchanged with the viewer.
+  uint64 input_events;
+} StreamStats;
+
+// Returns a hash of the width x height pixel rectangle at pixels. Any single
+// changed pixel is guaranteed to change the hash.
+uint64 HashStreamTile(const uint32* pixels, uint32 stride, uint32 width,
+                      uint32 height);
+// Appends the run length encoding of count contiguous pixels to output, and
+// returns the number of bytes appended.
+uint32 EncodeStreamTile(const uint32* pixels, uint32 count,
+                        ::std::vector<uint8>* output);
+// Decodes exactly count pixels from size bytes at data. Returns false if the
+// data is malformed.
+bool DecodeStreamTile(const uint8* data, uint32 size, uint32* pixels,
+                      uint32 count);
+
+class FramebufferServer {
+ public:
+  // Creates a server that streams window's software framebuffer under the
+  // pipe name. The window must outlive the server.
+  FramebufferServer(BaseWindow* window, const ::std::string& name);
+  FramebufferServer(const FramebufferServer& rhs) = delete;
+  ~FramebufferServer();
+
+  // Returns true if the pipe was created successfully.
+  bool IsValid() const;
+  // Returns true if a viewer is currently connected.
+  bool IsConnected() const;
+  // Accepts a pending viewer, posts any input it has sent to the window, and
+  // sends the tiles of the window's framebuffer that changed since the last
+  // frame that was sent. If the viewer has not consumed the previous frame
+  // this frame is dropped, and its changes are sent with a later frame. This
+  // call never blocks, so it may be made once per frame after drawing.
+  void Publish();
+  // Returns the server's statistics since construction.
+  const StreamStats& GetStats() const;
+
+ private:
+  // Connects a waiting viewer, if any.
+  void Accept();
+  // Drops the current viewer and listens for a new one.
+  void Disconnect();
+  // Reads and posts input messages from the viewer.
+  void ReceiveInput();
+  // Converts the pixel coordinates of a viewer mouse event to unit
+  // coordinates. Returns false if no frame has been sent to map them against.
+  bool ConvertViewerTarget(InputEvent* event) const;
+  // Appends a frame message for all changed tiles to outgoing_.
+  void EncodeFrame();
+  // Writes as much of outgoing_ as the pipe will accept. Returns true once
+  // everything has been written.
+  bool Flush();
+
+  BaseWindow* window_;
+  bool is_connected_;
+  uint32 frame_index_;
+  // The hash of every tile, as last sent to the viewer.
+  ::std::vector<uint64> tile_hashes_;
+  // The dimensions of the frame last sent to the viewer, in pixels.
+  uint32 frame_width_;
+  uint32 frame_height_;
+  // Set when the viewer must receive every tile on the next frame.
+  bool send_all_tiles_;
+  // Pending output, of which the first outgoing_offset_ bytes have been sent.
+  ::std::vector<uint8> outgoing_;
+  uint32 outgoing_offset_;
+  // Partially received input messages.
+  ::std::vector<uint8> incoming_;
+  // Contiguous copy of the tile being encoded.
+  ::std::vector<uint32> tile_pixels_;
+  StreamStats stats_;
+
+#if defined(BASE_PLATFORM_WINDOWS)
+  HANDLE pipe_;
+#endif
+};
+
+// Receives a framebuffer from a FramebufferServer, and sends input back to it.
+// Calls on a single client must not be made from multiple threads at once.
+class FramebufferClient {
+ public:
+  FramebufferClient();
+  FramebufferClient(const FramebufferClient& rhs) = delete;
+  ~FramebufferClient();
+
+  // Connects to the server with the pipe name, waiting up to timeout_ms for it
+  // to accept. Returns true on success.
+  bool Connect(const ::std::string& name, uint32 timeout_ms);
+  // Closes the connection.
+  void Disconnect();
+  // Returns true if the client is connected.
+  bool IsConnected() const;
+  // Blocks until the next frame arrives and applies it to the local copy of
+  // the framebuffer. Returns false and disconnects on error.
+  bool ReceiveFrame();
+  // Returns the local copy of the framebuffer. It is valid until the next
+  // call to ReceiveFrame.
+  PixelBuffer GetFrame();
+  // Sends an input event to the server's window. Mouse coordinates are in
+  // pixels of the frame returned by GetFrame.
+  bool SendInput(const InputEvent& event);
+  // Returns the client's statistics since construction.
+  const StreamStats& GetStats() const;
+
+ private:
+  // Reads exactly size bytes from the pipe.
+  bool ReadBytes(void* destination, uint32 size);
+
+  ::std::vector<uint32> frame_;
+  uint32 width_;
+  uint32 height_;
+  ::std::vector<uint8> payload_;
+  ::std::vector<uint32> tile_pixels_;
+  StreamStats stats_;
+
+#if defined(BASE_PLATFORM_WINDOWS)
+  HANDLE pipe_;
+#endif
+};
+
+uint64 HashStreamTile(const uint32* pixels, uint32 stride, uint32 width,
+                      uint32 height) {
+  // Each step is a bijection of the running hash for a fixed input, so a
+  // change to any one word cannot cancel out.
+  const uint64 kPrime = 0x100000001B3ULL;
+  uint64 hash = 0xCBF29CE484222325ULL ^ (uint64(width) << 32 | height);
+  for (uint32 y = 0; y < height; y++) {
+    const uint32* row = pixels + y * stride;
+    uint32 x = 0;
+    for (; x + 2 <= width; x += 2) {
+      uint64 word;
+      memcpy(&word, row + x, sizeof(word));
+      hash = (hash ^ word) * kPrime;
+    }
+    if (x < width) {
+      hash = (hash ^ row[x]) * kPrime;
+    }
+  }
+  return hash ^ (hash >> 32);
+}
+
+uint32 EncodeStreamTile(const uint32* pixels, uint32 count,
+                        ::std::vector<uint8>* output) {
+  size_t start = output->size();
+  // The worst case is a literal packet for every kStreamMaxPacketLength pixels.
+  output->resize(start + count * sizeof(uint32) +
+                 (count / kStreamMaxPacketLength + 1) * sizeof(uint16));
+  uint8* write = output->data() + start;
+  uint32 i = 0;
+
+  while (i < count) {
+    uint32 run = 1;
+    while (i + run < count && run < kStreamMaxPacketLength &&
+           pixels[i + run] == pixels[i]) {
+      run++;
+    }
+    if (run > 1) {
+      uint16 control = uint16(kStreamRunFlag | run);
+      memcpy(write, &control, sizeof(control));
+      memcpy(write + sizeof(control), pixels + i, sizeof(uint32));
+      write += sizeof(control) + sizeof(uint32);
+      i += run;
+      continue;
+    }
+
+    // Gather literals until the next run of two or more begins.
+    uint32 first = i;
+    while (i < count && i - first < kStreamMaxPacketLength &&
+           !(i + 1 < count && pixels[i + 1] == pixels[i])) {
+      i++;
+    }
+    uint16 control = uint16(i - first);
+    memcpy(write, &control, sizeof(control));
+    memcpy(write + sizeof(control), pixels + first, control * sizeof(uint32));
+    write += sizeof(control) + control * sizeof(uint32);
+  }
+
+  uint32 written = uint32(write - (output->data() + start));
+  output->resize(start + written);
+  return written;
+}
+
+bool DecodeStreamTile(const uint8* data, uint32 size, uint32* pixels,
+                      uint32 count) {
+  const uint8* end = data + size;
+  uint32 i = 0;
+
+  while (i < count) {
+    uint16 control;
+    if (end - data < int64(sizeof(control))) {
+      return false;
+    }
+    memcpy(&control, data, sizeof(control));
+    data += sizeof(control);
+    uint32 length = control & ~kStreamRunFlag;
+    if (!length || length > count - i) {
+      return false;
+    }
+    if (control & kStreamRunFlag) {
+      uint32 pixel;
+      if (end - data < int64(sizeof(pixel))) {
+        return false;
+      }
+      memcpy(&pixel, data, sizeof(pixel));
+      data += sizeof(pixel);
+      ::std::fill(pixels + i, pixels + i + length, pixel);
+    } else {
+      if (end - data < int64(length * sizeof(uint32))) {
+        return false;
+      }
+      memcpy(pixels + i, data, length * sizeof(uint32));
+      data += length * sizeof(uint32);
+    }
+    i += length;
+  }
+
+  return data == end;
+}
+
+FramebufferServer::FramebufferServer(BaseWindow* window,
+                                     const ::std::string& name)
+    : window_(window),
+      is_connected_(false),
+      frame_index_(0),
+      frame_width_(0),
+      frame_height_(0),
+      send_all_tiles_(true),
+      outgoing_offset_(0),
+      stats_() {
+  tile_pixels_.resize(kStreamTileSize * kStreamTileSize);
+#if defined(BASE_PLATFORM_WINDOWS)
+  ::std::string path = "\\\\.\\pipe\\" + name;
+  pipe_ = CreateNamedPipeA(
+      path.c_str(), PIPE_ACCESS_DUPLEX,
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_NOWAIT |
+          PIPE_REJECT_REMOTE_CLIENTS,
+      1, kStreamPipeBufferSize, kStreamPipeBufferSize, 0, NULL);
+#endif
+}
+
+FramebufferServer::~FramebufferServer() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  if (IsValid()) {
+    if (is_connected_) {
+      DisconnectNamedPipe(pipe_);
+    }
+    CloseHandle(pipe_);
+  }
+#endif
+}
+
+bool FramebufferServer::IsValid() const {
+#if defined(BASE_PLATFORM_WINDOWS)
+  return pipe_ != INVALID_HANDLE_VALUE;
+#else
+  return false;
+#endif
+}
+
+bool FramebufferServer::IsConnected() const { return is_connected_; }
+
+const StreamStats& FramebufferServer::GetStats() const { return stats_; }
+
+void FramebufferServer::Publish() {
+  if (!IsValid()) {
+    return;
+  }
+  if (!is_connected_) {
+    Accept();
+  }
+  if (is_connected_) {
+    ReceiveInput();
+  }
+  if (!is_connected_) {
+    return;
+  }
+  // Never queue more than one frame. A slow viewer sees fewer frames rather
+  // than older ones.
+  if (!Flush()) {
+    stats_.frames_dropped++;
+    return;
+  }
+  EncodeFrame();
+  Flush();
+}
+
+void FramebufferServer::Accept() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  // In non-blocking mode, ConnectNamedPipe succeeds when the pipe begins
+  // listening, and reports ERROR_PIPE_CONNECTED once a viewer has opened it.
+  if (ConnectNamedPipe(pipe_, NULL)) {
+    return;
+  }
+  DWORD error = GetLastError();
+  if (error == ERROR_PIPE_CONNECTED) {
+    is_connected_ = true;
+    send_all_tiles_ = true;
+    frame_width_ = 0;
+    frame_height_ = 0;
+    outgoing_.clear();
+    outgoing_offset_ = 0;
+    incoming_.clear();
+  } else if (error == ERROR_NO_DATA) {
+    // A viewer connected and closed before we noticed.
+    DisconnectNamedPipe(pipe_);
+  }
+#endif
+}
+
+void FramebufferServer::Disconnect() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  DisconnectNamedPipe(pipe_);
+#endif
+  is_connected_ = false;
+  outgoing_.clear();
+  outgoing_offset_ = 0;
+  incoming_.clear();
+}
+
+void FramebufferServer::ReceiveInput() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  DWORD available = 0;
+  if (!PeekNamedPipe(pipe_, NULL, 0, NULL, &available, NULL)) {
+    Disconnect();
+    return;
+  }
+  if (!available) {
+    return;
+  }
+  size_t offset = incoming_.size();
+  incoming_.resize(offset + available);
+  DWORD read = 0;
+  if (!ReadFile(pipe_, incoming_.data() + offset, available, &read, NULL)) {
+    Disconnect();
+    return;
+  }
+  incoming_.resize(offset + read);
+#endif
+
+  size_t consumed = 0;
+  while (incoming_.size() - consumed >= sizeof(StreamInputMessage)) {
+    StreamInputMessage message;
+    memcpy(&message, incoming_.data() + consumed, sizeof(message));
+    consumed += sizeof(message);
+    // A viewer that sends anything we would not produce ourselves is either
+    // broken or hostile, so we drop it rather than forward the event.
+    if (message.magic != kStreamInputMagic ||
+        (message.input_type != InputTypeSwitch &&
+         message.input_type != InputTypeTarget)) {
+      Disconnect();
+      return;
+    }
+    InputEvent event;
+    event.input_type = InputType(message.input_type);
+    event.switch_index = message.switch_index;
+    event.switch_extension = message.switch_extension;
+    event.target_x = message.target_x;
+    event.target_y = message.target_y;
+    event.is_on = message.is_on != 0;
+    if (!ConvertViewerTarget(&event)) {
+      continue;
+    }
+    window_->PostInputEvent(event);
+    stats_.input_events++;
+  }
+  incoming_.erase(incoming_.begin(), incoming_.begin() + consumed);
+}
+
+bool FramebufferServer::ConvertViewerTarget(InputEvent* event) const {
+  if (event->switch_index != kInputMouseMoveIndex &&
+      event->switch_index != kInputMouseLeftButtonIndex &&
+      event->switch_index != kInputMouseRightButtonIndex) {
+    return true;
+  }
+  if (!frame_width_ || !frame_height_) {
+    return false;
+  }
+  event->target_x = 2.0f * ((event->target_x + 0.5f) / frame_width_) - 1.0f;
+  event->target_y = -2.0f * ((event->target_y + 0.5f) / frame_height_) + 1.0f;
+  return true;
+}
+
+void FramebufferServer::EncodeFrame() {
+  PixelBuffer frame = window_->GetPixelBuffer();
+  uint32 tiles_x = (frame.width + kStreamTileSize - 1) / kStreamTileSize;
+  uint32 tiles_y = (frame.height + kStreamTileSize - 1) / kStreamTileSize;
+  // The viewer clears its copy of the frame whenever the dimensions change,
+  // even if the number of tiles does not, so every tile must be resent.
+  if (frame.width != frame_width_ || frame.height != frame_height_) {
+    frame_width_ = frame.width;
+    frame_height_ = frame.height;
+    tile_hashes_.assign(tiles_x * tiles_y, 0);
+    send_all_tiles_ = true;
+  }
+
+  StreamFrameHeader header;
+  header.magic = kStreamFrameMagic;
+  header.frame_index = frame_index_++;
+  header.width = frame.width;
+  header.height = frame.height;
+  header.tile_count = 0;
+  outgoing_.resize(sizeof(header));
+
+  for (uint32 ty = 0; ty < tiles_y; ty++) {
+    for (uint32 tx = 0; tx < tiles_x; tx++) {
+      uint32 x = tx * kStreamTileSize;
+      uint32 y = ty * kStreamTileSize;
+      uint32 width = ::std::min(kStreamTileSize, frame.width - x);
+      uint32 height = ::std::min(kStreamTileSize, frame.height - y);
+      const uint32* source = frame.pixels + y * frame.stride + x;
+      uint64 hash = HashStreamTile(source, frame.stride, width, height);
+      uint64& previous = tile_hashes_[ty * tiles_x + tx];
+      if (hash == previous && !send_all_tiles_) {
+        continue;
+      }
+      previous = hash;
+
+      for (uint32 row = 0; row < height; row++) {
+        memcpy(tile_pixels_.data() + row * width, source + row * frame.stride,
+               width * sizeof(uint32));
+      }
+      size_t tile_offset = outgoing_.size();
+      outgoing_.resize(tile_offset + sizeof(StreamTileHeader));
+      StreamTileHeader tile;
+      tile.tile_x = uint16(tx);
+      tile.tile_y = uint16(ty);
+      tile.encoded_size =
+          EncodeStreamTile(tile_pixels_.data(), width * height, &outgoing_);
+      memcpy(outgoing_.data() + tile_offset, &tile, sizeof(tile));
+      header.tile_count++;
+      stats_.raw_bytes += width * height * sizeof(uint32);
+    }
+  }
+
+  send_all_tiles_ = false;
+  header.payload_size = uint32(outgoing_.size() - sizeof(header));
+  memcpy(outgoing_.data(), &header, sizeof(header));
+  outgoing_offset_ = 0;
+
+  stats_.frames_sent++;
+  stats_.tiles_sent += header.tile_count;
+  stats_.bytes_sent += outgoing_.size();
+  stats_.last_frame_bytes = uint32(outgoing_.size());
+  stats_.last_frame_tiles = header.tile_count;
+}
+
+bool FramebufferServer::Flush() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  while (outgoing_offset_ < outgoing_.size()) {
+    DWORD written = 0;
+    DWORD remaining = DWORD(outgoing_.size() - outgoing_offset_);
+    // A non-blocking byte mode pipe accepts only what fits in its buffer.
+    if (!WriteFile(pipe_, outgoing_.data() + outgoing_offset_, remaining,
+                   &written, NULL)) {
+      Disconnect();
+      return false;
+    }
+    if (!written) {
+      return false;
+    }
+    outgoing_offset_ += written;
+  }
+#endif
+  outgoing_.clear();
+  outgoing_offset_ = 0;
+  return true;
+}
+
+FramebufferClient::FramebufferClient() : width_(0), height_(0), stats_() {
+  tile_pixels_.resize(kStreamTileSize * kStreamTileSize);
+#if defined(BASE_PLATFORM_WINDOWS)
+  pipe_ = INVALID_HANDLE_VALUE;
+#endif
+}
+
+FramebufferClient::~FramebufferClient() { Disconnect(); }
+
+bool FramebufferClient::Connect(const ::std::string& name, uint32 timeout_ms) {
+  Disconnect();
+#if defined(BASE_PLATFORM_WINDOWS)
+  ::std::string path = "\\\\.\\pipe\\" + name;
+  if (!WaitNamedPipeA(path.c_str(), timeout_ms)) {
+    return false;
+  }
+  pipe_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                      OPEN_EXISTING, 0, NULL);
+  return pipe_ != INVALID_HANDLE_VALUE;
+#else
+  return false;
+#endif
+}
+
+void FramebufferClient::Disconnect() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  if (pipe_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(pipe_);
+    pipe_ = INVALID_HANDLE_VALUE;
+  }
+#endif
+}
+
+bool FramebufferClient::IsConnected() const {
+#if defined(BASE_PLATFORM_WINDOWS)
+  return pipe_ != INVALID_HANDLE_VALUE;
+#else
+  return false;
+#endif
+}
+
+PixelBuffer FramebufferClient::GetFrame() {
+  PixelBuffer frame;
+  frame.pixels = frame_.data();
+  frame.width = width_;
+  frame.height = height_;
+  frame.stride = width_;
+  return frame;
+}
+
+const StreamStats& FramebufferClient::GetStats() const { return stats_; }
+
+bool FramebufferClient::ReadBytes(void* destination, uint32 size) {
+#if defined(BASE_PLATFORM_WINDOWS)
+  uint8* write = reinterpret_cast<uint8*>(destination);
+  while (size) {
+    DWORD read = 0;
+    if (!ReadFile(pipe_, write, size, &read, NULL) || !read) {
+      return false;
+    }
+    write += read;
+    size -= read;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool FramebufferClient::ReceiveFrame() {
+  StreamFrameHeader header;
+  if (!IsConnected() || !ReadBytes(&header, sizeof(header)) ||
+      header.magic != kStreamFrameMagic) {
+    Disconnect();
+    return false;
+  }
+  payload_.resize(header.payload_size);
+  if (!ReadBytes(payload_.data(), header.payload_size)) {
+    Disconnect();
+    return false;
+  }
+  if (header.width != width_ || header.height != height_) {
+    width_ = header.width;
+    height_ = header.height;
+    frame_.assign(size_t(width_) * height_, 0);
+  }
+
+  const uint8* read = payload_.data();
+  const uint8* end = read + payload_.size();
+  for (uint32 i = 0; i < header.tile_count; i++) {
+    StreamTileHeader tile;
+    if (end - read < int64(sizeof(tile))) {
+      Disconnect();
+      return false;
+    }
+    memcpy(&tile, read, sizeof(tile));
+    read += sizeof(tile);
+    uint32 x = tile.tile_x * kStreamTileSize;
+    uint32 y = tile.tile_y * kStreamTileSize;
+    if (x >= width_ || y >= height_ || end - read < int64(tile.encoded_size)) {
+      Disconnect();
+      return false;
+    }
+    uint32 width = ::std::min(kStreamTileSize, width_ - x);
+    uint32 height = ::std::min(kStreamTileSize, height_ - y);
+    if (!DecodeStreamTile(read, tile.encoded_size, tile_pixels_.data(),
+                          width * height)) {
+      Disconnect();
+      return false;
+    }
+    read += tile.encoded_size;
+    for (uint32 row = 0; row < height; row++) {
+      memcpy(frame_.data() + size_t(y + row) * width_ + x,
+             tile_pixels_.data() + row * width, width * sizeof(uint32));
+    }
+    stats_.raw_bytes += width * height * sizeof(uint32);
+  }
+
+  stats_.frames_sent++;
+  stats_.tiles_sent += header.tile_count;
+  stats_.bytes_sent += sizeof(header) + header.payload_size;
+  stats_.last_frame_bytes = uint32(sizeof(header) + header.payload_size);
+  stats_.last_frame_tiles = header.tile_count;
+  return true;
+}
+
+bool FramebufferClient::SendInput(const InputEvent& event) {
+  StreamInputMessage message;
+  message.magic = kStreamInputMagic;
+  message.input_type = uint8(event.input_type);
+  message.is_on = event.is_on ? 1 : 0;
+  message.reserved = 0;
+  message.switch_index = event.switch_index;
+  message.switch_extension = event.switch_extension;
+  message.target_x = event.target_x;
+  message.target_y = event.target_y;
+#if defined(BASE_PLATFORM_WINDOWS)
+  DWORD written = 0;
+  if (!IsConnected() ||
+      !WriteFile(pipe_, &message, sizeof(message), &written, NULL) ||
+      written != sizeof(message)) {
+    return false;
+  }
+  stats_.input_events++;
+  return true;
+#else
+  return false;
+#endif
+}
+
+}  // namespace base
+
+#endif  // __BASE_STREAM_H__
@@ -0,0 +1,506 @@
+/*
+//
+// Copyright (c) 1998-2019 Joe Bertolami. All Right Reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, CLUDG, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//   ARE DISCLAIMED.  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//   LIABLE FOR ANY DIRECT, DIRECT, CIDENTAL, SPECIAL, EXEMPLARY, OR
+//   CONSEQUENTIAL DAMAGES (CLUDG, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+//   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSESS TERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER  CONTRACT, STRICT
+//   LIABILITY, OR TORT (CLUDG NEGLIGENCE OR OTHERWISE) ARISG  ANY WAY  OF THE
+//   USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+//
+*/
+
+
+
+#ifndef __BASE_TASK_H__
+#define __BASE_TASK_H__
+
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "base_window.h"
+
+namespace base {
+
+// Coroutine frames are recycled through per-thread free lists in multiples of
+// kTaskFrameGranularity bytes, up to kTaskFrameMaxPooledSize. Larger frames
+// use the global heap.
+const size_t kTaskFrameGranularity = 64;
+const size_t kTaskFrameMaxPooledSize = 4096;
+
+typedef struct TaskFrameStats {
+  // Frames taken from the heap, and frames served from the free lists.
+  uint64 heap_allocations;
+  uint64 pooled_allocations;
+  // Frames currently in use.
+  uint64 live_frames;
+} TaskFrameStats;
+
+// Allocates coroutine frames for Task. Once a program has reached its steady
+// state, starting a task reuses the frame of one that has finished, so neither
+// starting tasks nor awaiting within them touches the heap. Frames must be
+// freed on the thread that allocated them.
+class TaskFrameAllocator {
+ public:
+  static void* Allocate(size_t size);
+  static void Free(void* frame, size_t size);
+  // Returns the statistics for the calling thread.
+  static const TaskFrameStats& GetStats();
+
+ private:
+  typedef struct FreeFrame {
+    FreeFrame* next;
+  } FreeFrame;
+
+  typedef struct Pool {
+    FreeFrame* free_lists[kTaskFrameMaxPooledSize / kTaskFrameGranularity];
+    TaskFrameStats stats;
+    ~Pool();
+  } Pool;
+
+  static Pool& GetPool();
+};
+
+// A coroutine that runs on a TaskScheduler. Tasks begin suspended. A task may
+// be given to TaskScheduler::Spawn to run on its own, or awaited from within
+// another task, in which case the awaiting task resumes once it completes.
+class Task {
+ public:
+  class promise_type {
+   public:
+    Task get_return_object() {
+      return Task(::std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    ::std::suspend_always initial_suspend() noexcept { return {}; }
+    // Hands control back to the awaiting task, if there is one.
+    auto final_suspend() noexcept {
+      struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        ::std::coroutine_handle<> await_suspend(
+            ::std::coroutine_handle<promise_type> handle) noexcept {
+          ::std::coroutine_handle<> continuation = handle.promise().continuation_;
+          return continuation ? continuation : ::std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+      };
+      return FinalAwaiter{};
+    }
+    void return_void() {}
+    void unhandled_exception() { ::std::terminate(); }
+
+    static void* operator new(size_t size) {
+      return TaskFrameAllocator::Allocate(size);
+    }
+    static void operator delete(void* frame, size_t size) {
+      TaskFrameAllocator::Free(frame, size);
+    }
+
+   private:
+    friend class Task;
+    ::std::coroutine_handle<> continuation_;
+  };
+
+  Task() : handle_(nullptr) {}
+  Task(Task&& rhs) : handle_(::std::exchange(rhs.handle_, nullptr)) {}
+  Task& operator=(Task&& rhs);
+  Task(const Task& rhs) = delete;
+  ~Task();
+
+  // Returns true if the task has run to completion.
+  bool IsDone() const;
+
+  // Awaiting a task starts it, and resumes the awaiting task when it is done.
+  bool await_ready() const { return !handle_ || handle_.done(); }
+  ::std::coroutine_handle<> await_suspend(::std::coroutine_handle<> awaiting) {
+    handle_.promise().continuation_ = awaiting;
+    return handle_;
+  }
+  void await_resume() const {}
+
+ private:
+  friend class TaskScheduler;
+  explicit Task(::std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+
+  ::std::coroutine_handle<promise_type> handle_;
+};
+
+// The common part of every TaskScheduler awaiter. Waiters live in the frame
+// of the suspended coroutine and are linked into the scheduler's lists, so
+// suspending never allocates.
+typedef struct TaskWaiter {
+  TaskWaiter* next;
+  ::std::coroutine_handle<> handle;
+} TaskWaiter;
+
+// A waiter for an input event. match tests an event against the awaiter's
+// filter without knowing its type, which lets every filter share one list.
+typedef struct TaskEventWaiter : TaskWaiter {
+  bool (*match)(TaskEventWaiter* waiter, const InputEvent& event);
+  InputEvent event;
+} TaskEventWaiter;
+
+// A waiter for a timer, which expires at wake_time seconds.
+typedef struct TaskSleepWaiter : TaskWaiter {
+  float64 wake_time;
+} TaskSleepWaiter;
+
+// A first in, first out list of waiters.
+typedef struct TaskWaitList {
+  TaskWaiter* head;
+  TaskWaiter** tail;
+} TaskWaitList;
+
+// Runs tasks that wait on a window's frames, input events, and timers. Tasks
+// are resumed from Update, on the thread that calls it. For example:
+//
+//   Task WaitForClick(TaskScheduler* scheduler) {
+//     InputEvent click = co_await scheduler->NextEvent(
+//         [](const InputEvent& event) {
+//           return event.switch_index == kInputMouseLeftButtonIndex &&
+//                  event.is_on;
+//         });
+//     co_await scheduler->Sleep(0.5);
+//     co_await scheduler->NextFrame();
+//   }
+class TaskScheduler {
+ public:
+  class FrameAwaiter;
+  class SleepAwaiter;
+  template <typename Filter>
+  class EventAwaiter;
+
+  // Creates a scheduler that updates window. The window must outlive the
+  // scheduler.
+  explicit TaskScheduler(BaseWindow* window);
+  TaskScheduler(const TaskScheduler& rhs) = delete;
+  // Destroys any tasks that have not yet finished.
+  ~TaskScheduler();
+
+  // Takes ownership of task and runs it until it first suspends.
+  void Spawn(Task task);
+  // Returns the number of spawned tasks that have not yet finished.
+  uint32 GetTaskCount() const;
+  // Updates the window, then resumes tasks waiting on each of its input
+  // events, on expired timers, and finally those that were waiting on the
+  // next frame when it began. Returns the result of BaseWindow::Update.
+  uint32 Update();
+
+  // Resumes at the end of the next Update, and yields the number of seconds
+  // since the previous Update.
+  FrameAwaiter NextFrame();
+  // Resumes with the next input event for which filter(event) is true. The
+  // filter is stored in the awaiting coroutine's frame.
+  template <typename Filter>
+  EventAwaiter<Filter> NextEvent(Filter filter);
+  // Resumes with the next input event.
+  EventAwaiter<bool (*)(const InputEvent&)> NextEvent();
+  // Resumes during the first Update at least seconds from now.
+  SleepAwaiter Sleep(float64 seconds);
+
+  class FrameAwaiter : private TaskWaiter {
+   public:
+    bool await_ready() const { return false; }
+    void await_suspend(::std::coroutine_handle<> awaiting) {
+      handle = awaiting;
+      Enqueue(&scheduler_->frame_waiters_, this);
+    }
+    float64 await_resume() const { return scheduler_->frame_seconds_; }
+
+   private:
+    friend class TaskScheduler;
+    explicit FrameAwaiter(TaskScheduler* scheduler) : scheduler_(scheduler) {}
+    TaskScheduler* scheduler_;
+  };
+
+  class SleepAwaiter : private TaskSleepWaiter {
+   public:
+    bool await_ready() const { return false; }
+    void await_suspend(::std::coroutine_handle<> awaiting) {
+      handle = awaiting;
+      Enqueue(&scheduler_->sleep_waiters_, this);
+    }
+    void await_resume() const {}
+
+   private:
+    friend class TaskScheduler;
+    SleepAwaiter(TaskScheduler* scheduler, float64 seconds)
+        : scheduler_(scheduler) {
+      wake_time = scheduler->GetTime() + seconds;
+    }
+    TaskScheduler* scheduler_;
+  };
+
+  template <typename Filter>
+  class EventAwaiter : private TaskEventWaiter {
+   public:
+    bool await_ready() const { return false; }
+    void await_suspend(::std::coroutine_handle<> awaiting) {
+      handle = awaiting;
+      Enqueue(&scheduler_->event_waiters_, this);
+    }
+    InputEvent await_resume() const { return event; }
+
+   private:
+    friend class TaskScheduler;
+    EventAwaiter(TaskScheduler* scheduler, Filter filter)
+        : scheduler_(scheduler), filter_(::std::move(filter)) {
+      match = [](TaskEventWaiter* waiter, const InputEvent& event) {
+        return bool(static_cast<EventAwaiter*>(waiter)->filter_(event));
+      };
+    }
+    TaskScheduler* scheduler_;
+    Filter filter_;
+  };
+
+ private:
+  static void Enqueue(TaskWaitList* list, TaskWaiter* waiter);
+  // Removes and returns every waiter in list, as a null terminated chain.
+  static TaskWaiter* TakeAll(TaskWaitList* list);
+  // Returns the number of seconds since the scheduler was created.
+  float64 GetTime() const;
+  // Destroys any spawned tasks that have finished.
+  void CollectTasks();
+
+  BaseWindow* window_;
+  ::std::vector<::std::coroutine_handle<Task::promise_type>> tasks_;
+  ::std::vector<InputEvent> events_;
+  TaskWaitList frame_waiters_;
+  TaskWaitList event_waiters_;
+  TaskWaitList sleep_waiters_;
+  ::std::chrono::steady_clock::time_point start_time_;
+  float64 last_update_time_;
+  float64 frame_seconds_;
+};
+
+/* Implementation */
+
+TaskFrameAllocator::Pool::~Pool() {
+  for (FreeFrame*& list : free_lists) {
+    while (list) {
+      FreeFrame* next = list->next;
+      ::operator delete(list);
+      list = next;
+    }
+  }
+}
+
+TaskFrameAllocator::Pool& TaskFrameAllocator::GetPool() {
+  thread_local Pool pool = {};
+  return pool;
+}
+
+const TaskFrameStats& TaskFrameAllocator::GetStats() {
+  return GetPool().stats;
+}
+
+void* TaskFrameAllocator::Allocate(size_t size) {
+  Pool& pool = GetPool();
+  pool.stats.live_frames++;
+  if (size > kTaskFrameMaxPooledSize) {
+    pool.stats.heap_allocations++;
+    return ::operator new(size);
+  }
+
+  size_t size_class = (size + kTaskFrameGranularity - 1) / kTaskFrameGranularity;
+  FreeFrame*& list = pool.free_lists[size_class - 1];
+  if (list) {
+    FreeFrame* frame = list;
+    list = frame->next;
+    pool.stats.pooled_allocations++;
+    return frame;
+  }
+  pool.stats.heap_allocations++;
+  return ::operator new(size_class * kTaskFrameGranularity);
+}
+
+void TaskFrameAllocator::Free(void* frame, size_t size) {
+  Pool& pool = GetPool();
+  pool.stats.live_frames--;
+  if (size > kTaskFrameMaxPooledSize) {
+    ::operator delete(frame);
+    return;
+  }
+
+  size_t size_class = (size + kTaskFrameGranularity - 1) / kTaskFrameGranularity;
+  FreeFrame* free_frame = static_cast<FreeFrame*>(frame);
+  free_frame->next = pool.free_lists[size_class - 1];
+  pool.free_lists[size_class - 1] = free_frame;
+}
+
+Task& Task::operator=(Task&& rhs) {
+  if (this != &rhs) {
+    if (handle_) {
+      handle_.destroy();
+    }
+    handle_ = ::std::exchange(rhs.handle_, nullptr);
+  }
+  return *this;
+}
+
+Task::~Task() {
+  if (handle_) {
+    handle_.destroy();
+  }
+}
+
+bool Task::IsDone() const { return !handle_ || handle_.done(); }
+
+TaskScheduler::TaskScheduler(BaseWindow* window)
+    : window_(window),
+      frame_waiters_{nullptr, &frame_waiters_.head},
+      event_waiters_{nullptr, &event_waiters_.head},
+      sleep_waiters_{nullptr, &sleep_waiters_.head},
+      start_time_(::std::chrono::steady_clock::now()),
+      last_update_time_(0),
+      frame_seconds_(0) {}
+
+TaskScheduler::~TaskScheduler() {
+  // The waiters live in the frames that we are about to destroy.
+  TakeAll(&frame_waiters_);
+  TakeAll(&event_waiters_);
+  TakeAll(&sleep_waiters_);
+  for (auto handle : tasks_) {
+    handle.destroy();
+  }
+}
+
+void TaskScheduler::Spawn(Task task) {
+  if (!task.handle_) {
+    return;
+  }
+  tasks_.push_back(::std::exchange(task.handle_, nullptr));
+  tasks_.back().resume();
+  CollectTasks();
+}
+
+uint32 TaskScheduler::GetTaskCount() const { return uint32(tasks_.size()); }
+
+uint32 TaskScheduler::Update() {
+  uint32 result = window_->Update(&events_);
+  float64 now = GetTime();
+  frame_seconds_ = now - last_update_time_;
+  last_update_time_ = now;
+
+  // Only tasks that were already waiting for a frame when this update began
+  // resume at its end. A task that reaches NextFrame from an event or a
+  // timer below waits for the next update.
+  TaskWaiter* frame_waiter = TakeAll(&frame_waiters_);
+
+  // Each event is offered to the waiters in the order that they began
+  // waiting. A task that resumes and waits again will see the events that
+  // follow within this same update.
+  for (const InputEvent& event : events_) {
+    TaskWaiter* waiter = TakeAll(&event_waiters_);
+    while (waiter) {
+      TaskWaiter* next = waiter->next;
+      TaskEventWaiter* event_waiter = static_cast<TaskEventWaiter*>(waiter);
+      if (event_waiter->match(event_waiter, event)) {
+        event_waiter->event = event;
+        waiter->handle.resume();
+      } else {
+        Enqueue(&event_waiters_, waiter);
+      }
+      waiter = next;
+    }
+  }
+
+  TaskWaiter* waiter = TakeAll(&sleep_waiters_);
+  while (waiter) {
+    TaskWaiter* next = waiter->next;
+    if (static_cast<TaskSleepWaiter*>(waiter)->wake_time <= now) {
+      waiter->handle.resume();
+    } else {
+      Enqueue(&sleep_waiters_, waiter);
+    }
+    waiter = next;
+  }
+
+  waiter = frame_waiter;
+  while (waiter) {
+    TaskWaiter* next = waiter->next;
+    waiter->handle.resume();
+    waiter = next;
+  }
+
+  CollectTasks();
+  return result;
+}
+
+TaskScheduler::FrameAwaiter TaskScheduler::NextFrame() {
+  return FrameAwaiter(this);
+}
+
+template <typename Filter>
+TaskScheduler::EventAwaiter<Filter> TaskScheduler::NextEvent(Filter filter) {
+  return EventAwaiter<Filter>(this, ::std::move(filter));
+}
+
+TaskScheduler::EventAwaiter<bool (*)(const InputEvent&)>
+TaskScheduler::NextEvent() {
+  return NextEvent(+[](const InputEvent&) { return true; });
+}
+
+TaskScheduler::SleepAwaiter TaskScheduler::Sleep(float64 seconds) {
+  return SleepAwaiter(this, seconds);
+}
+
+void TaskScheduler::Enqueue(TaskWaitList* list, TaskWaiter* waiter) {
+  waiter->next = nullptr;
+  *list->tail = waiter;
+  list->tail = &waiter->next;
+}
+
+TaskWaiter* TaskScheduler::TakeAll(TaskWaitList* list) {
+  TaskWaiter* head = list->head;
+  list->head = nullptr;
+  list->tail = &list->head;
+  return head;
+}
+
+float64 TaskScheduler::GetTime() const {
+  return ::std::chrono::duration<float64>(::std::chrono::steady_clock::now() -
+                                          start_time_)
+      .count();
+}
+
+void TaskScheduler::CollectTasks() {
+  tasks_.erase(::std::remove_if(tasks_.begin(), tasks_.end(),
+                                [](::std::coroutine_handle<Task::promise_type>
+                                       handle) {
+                                  if (handle.done()) {
+                                    handle.destroy();
+                                    return true;
+                                  }
+                                  return false;
+                                }),
+               tasks_.end());
+}
+
+}  // namespace base
+
+#endif  // __BASE_TASK_H__
@@ -32,7 +32,12 @@
 #ifndef __BASE_WINDOW_H__
 #define __BASE_WINDOW_H__
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -41,7 +46,14 @@
 
 #if defined(WIN32) || defined(_WIN64)
 #define BASE_PLATFORM_WINDOWS
+// Without this, windows.h defines min and max macros that break any use of
+// ::std::min and ::std::max in code that follows it.
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include "windows.h"
+#include "dwmapi.h"
+#include "xinput.h"
 #elif defined(__APPLE__)
 #define BASE_PLATFORM_MACOS
 #include "TargetConditionals.h"
@@ -90,11 +102,102 @@ const uint32 kInputMouseMoveIndex = 0x100000;
 const uint32 kInputMouseWheelIndex = 0x100001;
 const uint32 kInputMouseLeftButtonIndex = 0x100002;
 const uint32 kInputMouseRightButtonIndex = 0x100003;
+// Relative mouse motion, read directly from the device before pointer
+// acceleration is applied. Each event carries one device report, with
+// target_x and target_y holding the motion in device units (positive x is
+// right, positive y is down). Only sent after SetRawMouseInput(true).
+const uint32 kInputMouseRawMotionIndex = 0x100004;
+
+// Gamepads are assigned consecutive ranges of kInputGamepadIndexStride indices,
+// beginning at kInputGamepadBaseIndex. Use GetGamepadIndex to combine a device
+// number with one of the offsets below. Buttons are switches. Sticks are
+// targets with axes in -1...1 (positive y is up). The trigger target holds the
+// left trigger in target_x and the right trigger in target_y, each in 0...1.
+// The connection switch is on while the device is present.
+const uint32 kInputGamepadBaseIndex = 0x102000;
+const uint32 kInputGamepadIndexStride = 0x100;
+const uint32 kMaxGamepads = 4;
+const uint32 kInputGamepadDPadUpOffset = 0;
+const uint32 kInputGamepadDPadDownOffset = 1;
+const uint32 kInputGamepadDPadLeftOffset = 2;
+const uint32 kInputGamepadDPadRightOffset = 3;
+const uint32 kInputGamepadStartOffset = 4;
+const uint32 kInputGamepadBackOffset = 5;
+const uint32 kInputGamepadLeftThumbOffset = 6;
+const uint32 kInputGamepadRightThumbOffset = 7;
+const uint32 kInputGamepadLeftShoulderOffset = 8;
+const uint32 kInputGamepadRightShoulderOffset = 9;
+const uint32 kInputGamepadAOffset = 12;
+const uint32 kInputGamepadBOffset = 13;
+const uint32 kInputGamepadXOffset = 14;
+const uint32 kInputGamepadYOffset = 15;
+const uint32 kInputGamepadLeftStickOffset = 0x40;
+const uint32 kInputGamepadRightStickOffset = 0x41;
+const uint32 kInputGamepadTriggerOffset = 0x42;
+const uint32 kInputGamepadConnectionOffset = 0x4F;
 const uint32 kInputKeyControlIndex = 0x101000;
 const uint32 kInputKeyCommandIndex = 0x101001;
 const uint32 kInputKeyAltIndex = 0x101002;
 const uint32 kInputKeyShiftIndex = 0x101003;
 
+// Keyboard events share a single key code space on every platform. Keys that
+// print a character use that character's ASCII value when unshifted (letters
+// use their upper case value), so the escape key is 27 and the A key is 'A'.
+// The remaining keys use the indices below, plus the modifier indices above.
+//
+// For key events, switch_extension holds the character produced by the key
+// under the current shift and caps lock state (zero for non-printing keys) in
+// its low 32 bits, and the kInputKeyModifier flags held at the time of the
+// event in its high 32 bits.
+const uint32 kInputKeyBackspaceIndex = 8;
+const uint32 kInputKeyTabIndex = 9;
+const uint32 kInputKeyEnterIndex = 13;
+const uint32 kInputKeyEscapeIndex = 27;
+const uint32 kInputKeySpaceIndex = 32;
+const uint32 kInputKeyDeleteIndex = 0x100;
+const uint32 kInputKeyInsertIndex = 0x101;
+const uint32 kInputKeyHomeIndex = 0x102;
+const uint32 kInputKeyEndIndex = 0x103;
+const uint32 kInputKeyPageUpIndex = 0x104;
+const uint32 kInputKeyPageDownIndex = 0x105;
+const uint32 kInputKeyLeftIndex = 0x106;
+const uint32 kInputKeyRightIndex = 0x107;
+const uint32 kInputKeyUpIndex = 0x108;
+const uint32 kInputKeyDownIndex = 0x109;
+const uint32 kInputKeyCapsLockIndex = 0x10A;
+const uint32 kInputKeyNumLockIndex = 0x10B;
+const uint32 kInputKeyScrollLockIndex = 0x10C;
+const uint32 kInputKeyPrintScreenIndex = 0x10D;
+const uint32 kInputKeyPauseIndex = 0x10E;
+const uint32 kInputKeyMenuIndex = 0x10F;
+// Numpad digits are consecutive, from kInputKeyNumpad0Index.
+const uint32 kInputKeyNumpad0Index = 0x110;
+const uint32 kInputKeyNumpadDecimalIndex = 0x11A;
+const uint32 kInputKeyNumpadAddIndex = 0x11B;
+const uint32 kInputKeyNumpadSubtractIndex = 0x11C;
+const uint32 kInputKeyNumpadMultiplyIndex = 0x11D;
+const uint32 kInputKeyNumpadDivideIndex = 0x11E;
+// Function keys F1 through F24 are consecutive, from kInputKeyF1Index.
+const uint32 kInputKeyF1Index = 0x120;
+const uint32 kInputKeyF24Index = 0x137;
+
+const uint32 kInputKeyModifierShift = 0x01;
+const uint32 kInputKeyModifierControl = 0x02;
+const uint32 kInputKeyModifierAlt = 0x04;
+const uint32 kInputKeyModifierCommand = 0x08;
+const uint32 kInputKeyModifierCapsLock = 0x10;
+
+// Window state changes are reported as switches. The focus switch is on while
+// the window has keyboard focus, and the visible switch is on while any part
+// of the window can be seen (see BaseWindow::IsVisible).
+const uint32 kInputWindowFocusIndex = 0x103000;
+const uint32 kInputWindowVisibleIndex = 0x103001;
+// Sent by Update when the size of the window's client area has changed, with
+// the new width and height in pixels in target_x and target_y. Resizes are
+// applied once per Update, so an interactive drag produces at most one event
+// (and one change to GetWidth and GetHeight) per frame.
+const uint32 kInputWindowResizeIndex = 0x103002;
+
 enum InputType : uint8 {
   InputTypeUnknown,
   InputTypeSwitch,
@@ -120,6 +223,143 @@ typedef struct InputEvent {
   bool is_on;
 } InputEvent;
 
+// Translates a platform's native key codes (which must be below 256) into our
+// key code space. Tables are generated at compile time, so translating a key
+// event is a handful of array lookups with no branches.
+typedef struct KeyTranslationTable {
+  // The key code for each native key.
+  uint32 keys[256];
+  // The modifier flag that is held while each native key is down.
+  uint8 modifiers[256];
+  // The modifier flag that is toggled each time a native key is pressed.
+  uint8 toggles[256];
+  // The character for each native key, indexed first by the shift state in
+  // bit 0 and the caps lock state in bit 1.
+  uint8 characters[4][256];
+} KeyTranslationTable;
+
+// Returns the character that key produces on a US layout, or zero if it does
+// not print.
+constexpr uint8 GetKeyCharacter(uint32 key, bool shift, bool caps_lock) {
+  if (key >= 'A' && key <= 'Z') {
+    return uint8((shift != caps_lock) ? key : key + ('a' - 'A'));
+  }
+  if (key >= kInputKeyNumpad0Index && key <= kInputKeyNumpad0Index + 9) {
+    return uint8('0' + (key - kInputKeyNumpad0Index));
+  }
+
+  const char* unshifted = "1234567890-=[]\\;',./`";
+  const char* shifted = "!@#$%^&*()_+{}|:\"<>?~";
+  for (uint32 i = 0; unshifted[i]; i++) {
+    if (key == uint32(unshifted[i])) {
+      return uint8(shift ? shifted[i] : unshifted[i]);
+    }
+  }
+
+  switch (key) {
+    case kInputKeyBackspaceIndex:
+    case kInputKeyTabIndex:
+    case kInputKeyEnterIndex:
+    case kInputKeyEscapeIndex:
+    case kInputKeySpaceIndex:
+      return uint8(key);
+    case kInputKeyNumpadDecimalIndex:
+      return '.';
+    case kInputKeyNumpadAddIndex:
+      return '+';
+    case kInputKeyNumpadSubtractIndex:
+      return '-';
+    case kInputKeyNumpadMultiplyIndex:
+      return '*';
+    case kInputKeyNumpadDivideIndex:
+      return '/';
+  }
+  return 0;
+}
+
+// Returns the modifier flag held by key, or zero.
+constexpr uint8 GetKeyModifier(uint32 key) {
+  return uint8(key == kInputKeyShiftIndex     ? kInputKeyModifierShift
+               : key == kInputKeyControlIndex ? kInputKeyModifierControl
+               : key == kInputKeyAltIndex     ? kInputKeyModifierAlt
+               : key == kInputKeyCommandIndex ? kInputKeyModifierCommand
+                                              : 0);
+}
+
+// Builds the translation table for a platform, given a function that maps
+// each native key code to our key code space.
+constexpr KeyTranslationTable BuildKeyTranslationTable(
+    uint32 (*convert)(uint32)) {
+  KeyTranslationTable table = {};
+  for (uint32 native = 0; native < 256; native++) {
+    uint32 key = convert(native);
+    table.keys[native] = key;
+    table.modifiers[native] = GetKeyModifier(key);
+    table.toggles[native] =
+        uint8(key == kInputKeyCapsLockIndex ? kInputKeyModifierCapsLock : 0);
+    for (uint32 plane = 0; plane < 4; plane++) {
+      table.characters[plane][native] =
+          GetKeyCharacter(key, plane & 1, (plane >> 1) & 1);
+    }
+  }
+  return table;
+}
+
+// Fills in the key event for a press or release of native_key, and updates
+// the modifier flags to reflect it.
+void TranslateKey(const KeyTranslationTable& table, uint32 native_key,
+                  bool is_on, uint32* modifiers, InputEvent* event);
+
+// A snapshot of a gamepad. Bit n of buttons holds the button at offset n.
+// Stick axes range from -1...1 and triggers from 0...1, after dead zones have
+// been applied.
+typedef struct GamepadState {
+  bool is_connected;
+  uint16 buttons;
+  float32 left_x;
+  float32 left_y;
+  float32 right_x;
+  float32 right_y;
+  float32 left_trigger;
+  float32 right_trigger;
+} GamepadState;
+
+// Reads the current state of gamepad device into state. Returns false if the
+// device could not be read. Must not block.
+typedef bool (*GamepadPollFunction)(uint32 device, GamepadState* state);
+
+// Returns the switch index for offset on gamepad device.
+uint64 GetGamepadIndex(uint32 device, uint32 offset);
+// Appends the events that describe the change from previous to current on
+// gamepad device. A disconnect releases any held buttons.
+void TranslateGamepadState(uint32 device, const GamepadState& previous,
+                           const GamepadState& current,
+                           ::std::vector<InputEvent>* events);
+// Reads an XInput controller, which is the default poll function.
+bool PollXInputGamepad(uint32 device, GamepadState* state);
+
+// Timings for the construction of a window, which help to keep startup fast.
+typedef struct WindowCreationStats {
+  // The time spent creating the OS window, and (for a GraphicsWindow) its
+  // graphics context, in seconds.
+  float64 window_seconds;
+  float64 graphics_seconds;
+  // True if the window reused the process's window class registration, or
+  // a pixel format chosen for an earlier window.
+  bool reused_window_class;
+  bool reused_pixel_format;
+} WindowCreationStats;
+
+// A view of 32 bit pixels in the native format of the window system, which is
+// BGRA in memory (0xAARRGGBB when read as a uint32). Rows are stored from top
+// to bottom and are stride pixels apart.
+typedef struct PixelBuffer {
+  uint32* pixels;
+  uint32 width;
+  uint32 height;
+  uint32 stride;
+} PixelBuffer;
+
 class BaseWindow {
  public:
   BaseWindow(const ::std::string& title, uint32 x, uint32 y, uint32 width,
@@ -145,6 +385,16 @@ class BaseWindow {
   void SetVisible(bool visible);
   // Toggles whether the cursor should be visible.
   void SetCursorVisible(bool visible);
+  // Toggles delivery of kInputMouseRawMotionIndex events. Raw motion is
+  // sampled at the device's report rate rather than the cursor's update rate,
+  // and is batched into the queue by each call to Update. The OS delivers raw
+  // motion to a single window per process, so if several windows enable it,
+  // the most recent receives it until it disables it or is destroyed.
+  void SetRawMouseInput(bool enabled);
+  // Toggles polling of gamepads during Update. Changes in their state are
+  // added to the queue as gamepad events. The optional poll function replaces
+  // the platform's gamepad source, which allows input to be scripted.
+  void SetGamepadInput(bool enabled, GamepadPollFunction poll = nullptr);
   // Returns the x pixel coordinate of the upper left corner of the window.
   uint32 GetOriginX() const;
   // Returns the y pixel coordinate of the upper left corner of the window.
@@ -155,6 +405,26 @@ class BaseWindow {
   uint32 GetHeight() const;
   // Returns the title of the window.
   const ::std::string& GetTitle() const;
+  // Returns true if the window may be seen by the user. A window that is
+  // minimized, hidden, or fully covered (e.g. on another virtual desktop) is
+  // not visible.
+  bool IsVisible() const;
+  // Returns true if the window has keyboard focus.
+  bool IsFocused() const;
+  // Returns how long the window took to create.
+  const WindowCreationStats& GetCreationStats() const;
+  // Returns the software framebuffer of the window, which matches the size of
+  // the window and is allocated on first use. Its contents are displayed by
+  // PresentPixels. When the window is resized the framebuffer is cleared, and
+  // its storage is reused unless it has grown, so the returned view should be
+  // fetched again each frame.
+  PixelBuffer GetPixelBuffer();
+  // Copies the software framebuffer to the window.
+  void PresentPixels();
+  // Appends an input event to the window's input cache, as if it had been
+  // received from the OS. This allows other input sources (e.g. remote
+  // viewers) to feed events through the normal Update path.
+  void PostInputEvent(const InputEvent& event);
 
  protected:
   // Protected constructor added for derived classes.
@@ -183,10 +453,53 @@ class BaseWindow {
   // The input cache asynchronously retrieves input commands from the OS
   // and preserves them for users.
   ::std::vector<InputEvent> input_cache_;
+  // Backing storage for the software framebuffer.
+  ::std::vector<uint32> pixels_;
+  // The dimensions of the software framebuffer, in pixels.
+  uint32 pixel_width_;
+  uint32 pixel_height_;
+  uint32 pixel_stride_;
+  // Set while the window is registered for raw mouse input.
+  bool raw_mouse_enabled_;
+  // The kInputKeyModifier flags currently held or toggled on.
+  uint32 key_modifiers_;
+  // Visibility and focus, as last reported by the OS.
+  bool is_minimized_;
+  bool is_hidden_;
+  bool is_occluded_;
+  bool is_focused_;
+  // The visibility last reported through kInputWindowVisibleIndex.
+  bool was_visible_;
+  // The most recent client area size reported by the OS, which is applied to
+  // width_ and height_ by the next Update. Mouse coordinates are normalized
+  // against this size, as it is the size the OS used to produce them.
+  uint32 client_width_;
+  uint32 client_height_;
+  // Set if the user may resize the window (BASE_WINDOW_STYLE_SIZABLE).
+  bool is_sizable_;
+  // The client area size to restore when the window leaves fullscreen.
+  uint32 windowed_width_;
+  uint32 windowed_height_;
+  WindowCreationStats creation_stats_;
+  // The source of gamepad state, or null when gamepads are not polled.
+  GamepadPollFunction gamepad_poll_;
+  // The last state read from each gamepad.
+  GamepadState gamepad_states_[kMaxGamepads];
 
 #if defined(BASE_PLATFORM_WINDOWS)
+  // Converts a raw input report into input events.
+  void ProcessRawInput(const RAWINPUT* raw);
+  // Checks whether the window is covered, and reports any change in its
+  // visibility.
+  void UpdateVisibility();
+  // Applies and reports the most recent client area size.
+  void ApplyPendingResize();
+
   HWND window_handle_;
   HINSTANCE instance_;
+  // Scratch space for reading raw input reports in bulk. Reports are pointer
+  // aligned, so we back this with 64 bit words.
+  ::std::vector<uint64> raw_input_buffer_;
   friend LRESULT CALLBACK DefWndProc(HWND hWnd, uint32 message, WPARAM wParam,
                                      LPARAM lParam);
 #elif defined(BASE_PLATFORM_MACOS)
@@ -197,10 +510,38 @@ class BaseWindow {
 /* Implementation */
 
 BaseWindow::BaseWindow()
-    : is_valid_(false), origin_x_(0), origin_y_(0), width_(0), height_(0) {}
+    : is_valid_(false),
+      origin_x_(0),
+      origin_y_(0),
+      width_(0),
+      height_(0),
+      pixel_width_(0),
+      pixel_height_(0),
+      pixel_stride_(0),
+      raw_mouse_enabled_(false),
+      key_modifiers_(0),
+      is_minimized_(false),
+      is_hidden_(true),
+      is_occluded_(false),
+      is_focused_(false),
+      was_visible_(false),
+      client_width_(0),
+      client_height_(0),
+      is_sizable_(false),
+      windowed_width_(0),
+      windowed_height_(0),
+      creation_stats_(),
+      gamepad_poll_(nullptr),
+      gamepad_states_() {
+#if defined(BASE_PLATFORM_WINDOWS)
+  window_handle_ = NULL;
+  instance_ = NULL;
+#endif
+}
 
 BaseWindow::BaseWindow(const ::std::string& title, uint32 x, uint32 y,
-                       uint32 width, uint32 height, uint32 style_flags) {
+                       uint32 width, uint32 height, uint32 style_flags)
+    : BaseWindow() {
   Create(title, x, y, width, height, style_flags);
 }
 
@@ -218,10 +559,150 @@ uint32 BaseWindow::GetHeight() const { return height_; }
 
 const ::std::string& BaseWindow::GetTitle() const { return title_; }
 
+bool BaseWindow::IsVisible() const {
+  return is_valid_ && !is_minimized_ && !is_hidden_ && !is_occluded_;
+}
+
+bool BaseWindow::IsFocused() const { return is_focused_; }
+
+const WindowCreationStats& BaseWindow::GetCreationStats() const {
+  return creation_stats_;
+}
+
+void BaseWindow::PostInputEvent(const InputEvent& event) {
+  input_cache_.push_back(event);
+}
+
+void BaseWindow::SetGamepadInput(bool enabled, GamepadPollFunction poll) {
+#if defined(BASE_PLATFORM_WINDOWS)
+  GamepadPollFunction default_poll = PollXInputGamepad;
+#else
+  GamepadPollFunction default_poll = nullptr;
+#endif
+  gamepad_poll_ = enabled ? (poll ? poll : default_poll) : nullptr;
+
+  // Releasing our view of every device means that connection events are
+  // reported afresh when polling resumes.
+  for (uint32 i = 0; i < kMaxGamepads; i++) {
+    TranslateGamepadState(i, gamepad_states_[i], GamepadState(),
+                          &input_cache_);
+    gamepad_states_[i] = GamepadState();
+  }
+}
+
+void TranslateKey(const KeyTranslationTable& table, uint32 native_key,
+                  bool is_on, uint32* modifiers, InputEvent* event) {
+  native_key &= 0xFF;
+  uint32 pressed = 0u - uint32(is_on);
+  uint32 held = table.modifiers[native_key];
+  *modifiers = (*modifiers & ~held) | (held & pressed);
+  *modifiers ^= table.toggles[native_key] & pressed;
+
+  uint32 plane = (*modifiers & kInputKeyModifierShift) |
+                 ((*modifiers & kInputKeyModifierCapsLock) >> 3);
+  event->input_type = InputTypeSwitch;
+  event->switch_index = table.keys[native_key];
+  event->switch_extension = table.characters[plane][native_key] |
+                            (uint64(*modifiers) << 32);
+  event->target_x = 0;
+  event->target_y = 0;
+  event->is_on = is_on;
+}
+
+uint64 GetGamepadIndex(uint32 device, uint32 offset) {
+  return kInputGamepadBaseIndex + device * kInputGamepadIndexStride + offset;
+}
+
+void TranslateGamepadState(uint32 device, const GamepadState& previous,
+                           const GamepadState& current,
+                           ::std::vector<InputEvent>* events) {
+  InputEvent event;
+  event.switch_extension = 0;
+
+  if (previous.is_connected != current.is_connected) {
+    event.input_type = InputTypeSwitch;
+    event.switch_index = GetGamepadIndex(device, kInputGamepadConnectionOffset);
+    event.target_x = 0;
+    event.target_y = 0;
+    event.is_on = current.is_connected;
+    events->push_back(event);
+  }
+
+  // A disconnected device reports nothing held and everything centered.
+  GamepadState next = current.is_connected ? current : GamepadState();
+
+  uint16 changed = previous.buttons ^ next.buttons;
+  for (uint32 i = 0; changed; i++, changed >>= 1) {
+    if (changed & 1) {
+      event.input_type = InputTypeSwitch;
+      event.switch_index = GetGamepadIndex(device, i);
+      event.target_x = 0;
+      event.target_y = 0;
+      event.is_on = (next.buttons >> i) & 1;
+      events->push_back(event);
+    }
+  }
+
+  const struct {
+    uint32 offset;
+    float32 previous_x, previous_y, next_x, next_y;
+  } targets[] = {
+      {kInputGamepadLeftStickOffset, previous.left_x, previous.left_y,
+       next.left_x, next.left_y},
+      {kInputGamepadRightStickOffset, previous.right_x, previous.right_y,
+       next.right_x, next.right_y},
+      {kInputGamepadTriggerOffset, previous.left_trigger,
+       previous.right_trigger, next.left_trigger, next.right_trigger},
+  };
+
+  for (const auto& target : targets) {
+    if (target.previous_x != target.next_x ||
+        target.previous_y != target.next_y) {
+      event.input_type = InputTypeTarget;
+      event.switch_index = GetGamepadIndex(device, target.offset);
+      event.target_x = target.next_x;
+      event.target_y = target.next_y;
+      event.is_on = (target.next_x != 0 || target.next_y != 0);
+      events->push_back(event);
+    }
+  }
+}
+
+PixelBuffer BaseWindow::GetPixelBuffer() {
+  if (pixel_width_ != width_ || pixel_height_ != height_) {
+    // Rows are padded to a multiple of 8 pixels (32 bytes) so that SIMD
+    // kernels can process whole rows with aligned strides.
+    pixel_width_ = width_;
+    pixel_height_ = height_;
+    pixel_stride_ = (width_ + 7) & ~7u;
+
+    // Storage grows geometrically, and is only released once the window has
+    // shrunk to a fraction of it, so that a drag resize settles into reusing
+    // a single allocation.
+    size_t required = size_t(pixel_stride_) * pixel_height_;
+    if (required > pixels_.size() || required < pixels_.size() / 4) {
+      size_t capacity = required;
+      if (required > pixels_.size()) {
+        capacity = ::std::max(required, pixels_.size() + pixels_.size() / 2);
+      }
+      ::std::vector<uint32>(capacity).swap(pixels_);
+    } else {
+      ::std::fill(pixels_.begin(), pixels_.begin() + required, 0);
+    }
+  }
+
+  PixelBuffer buffer = {pixels_.data(), pixel_width_, pixel_height_,
+                        pixel_stride_};
+  return buffer;
+}
+
 }  // namespace base
 
 #if defined(BASE_PLATFORM_WINDOWS)
+#pragma comment(lib, "dwmapi.lib")
+
 #define BASE_WINDOW_STYLE_WINDOWED_STYLE (WS_SYSMENU | WS_VISIBLE)
+#define BASE_WINDOW_STYLE_SIZABLE_STYLE (WS_THICKFRAME | WS_MAXIMIZEBOX)
 #define BASE_WINDOW_STYLE_FULLSCREEN_STYLE (WS_POPUP | WS_VISIBLE)
 
 #define GET_UNIT_X_VALUE(value, span) \
@@ -233,7 +714,94 @@ namespace base {
 
 const uint16 kDefaultInputEventQueueCapacity = 32;
 
-uint32 ConvertScan(uint32 scancode, uint32 shift);
+// Every window shares a single window class, which is registered by the first
+// window and unregistered when the last one is destroyed.
+const WCHAR kWindowClassName[] = L"BaseWindow";
+
+// Registers the shared window class if needed, and returns true on success.
+// Sets reused to true if the class was already registered.
+bool AcquireWindowClass(HINSTANCE instance, bool* reused);
+// Releases a reference to the shared window class.
+void ReleaseWindowClass(HINSTANCE instance);
+// Returns the window that raw mouse input is delivered to, if any.
+HWND GetRawInputTarget();
+
+// Maps a Win32 virtual key code into our key code space.
+constexpr uint32 ConvertVirtualKey(uint32 virtual_key) {
+  if ((virtual_key >= '0' && virtual_key <= '9') ||
+      (virtual_key >= 'A' && virtual_key <= 'Z')) {
+    return virtual_key;
+  }
+  if (virtual_key >= VK_NUMPAD0 && virtual_key <= VK_NUMPAD9) {
+    return kInputKeyNumpad0Index + (virtual_key - VK_NUMPAD0);
+  }
+  if (virtual_key >= VK_F1 && virtual_key <= VK_F24) {
+    return kInputKeyF1Index + (virtual_key - VK_F1);
+  }
+
+  switch (virtual_key) {
+    case VK_BACK: return kInputKeyBackspaceIndex;
+    case VK_TAB: return kInputKeyTabIndex;
+    case VK_RETURN: return kInputKeyEnterIndex;
+    case VK_ESCAPE: return kInputKeyEscapeIndex;
+    case VK_SPACE: return kInputKeySpaceIndex;
+    case VK_SHIFT: return kInputKeyShiftIndex;
+    case VK_CONTROL: return kInputKeyControlIndex;
+    case VK_MENU: return kInputKeyAltIndex;
+    case VK_LWIN: return kInputKeyCommandIndex;
+    case VK_RWIN: return kInputKeyCommandIndex;
+    case VK_DELETE: return kInputKeyDeleteIndex;
+    case VK_INSERT: return kInputKeyInsertIndex;
+    case VK_HOME: return kInputKeyHomeIndex;
+    case VK_END: return kInputKeyEndIndex;
+    case VK_PRIOR: return kInputKeyPageUpIndex;
+    case VK_NEXT: return kInputKeyPageDownIndex;
+    case VK_LEFT: return kInputKeyLeftIndex;
+    case VK_RIGHT: return kInputKeyRightIndex;
+    case VK_UP: return kInputKeyUpIndex;
+    case VK_DOWN: return kInputKeyDownIndex;
+    case VK_CAPITAL: return kInputKeyCapsLockIndex;
+    case VK_NUMLOCK: return kInputKeyNumLockIndex;
+    case VK_SCROLL: return kInputKeyScrollLockIndex;
+    case VK_SNAPSHOT: return kInputKeyPrintScreenIndex;
+    case VK_PAUSE: return kInputKeyPauseIndex;
+    case VK_APPS: return kInputKeyMenuIndex;
+    case VK_DECIMAL: return kInputKeyNumpadDecimalIndex;
+    case VK_ADD: return kInputKeyNumpadAddIndex;
+    case VK_SUBTRACT: return kInputKeyNumpadSubtractIndex;
+    case VK_MULTIPLY: return kInputKeyNumpadMultiplyIndex;
+    case VK_DIVIDE: return kInputKeyNumpadDivideIndex;
+    // The OEM keys are named for the characters they print on a US layout.
+    case VK_OEM_1: return ';';
+    case VK_OEM_PLUS: return '=';
+    case VK_OEM_COMMA: return ',';
+    case VK_OEM_MINUS: return '-';
+    case VK_OEM_PERIOD: return '.';
+    case VK_OEM_2: return '/';
+    case VK_OEM_3: return '`';
+    case VK_OEM_4: return '[';
+    case VK_OEM_5: return '\\';
+    case VK_OEM_6: return ']';
+    case VK_OEM_7: return '\'';
+  }
+  // Unmapped keys are passed through above the rest of the key space, so
+  // that they remain distinguishable.
+  return 0x200 + virtual_key;
+}
+
+constexpr KeyTranslationTable kVirtualKeyTable =
+    BuildKeyTranslationTable(ConvertVirtualKey);
+
+// Reads the modifier flags from the keyboard state.
+uint32 ReadKeyModifiers() {
+  return ((GetKeyState(VK_SHIFT) & 0x8000) ? kInputKeyModifierShift : 0) |
+         ((GetKeyState(VK_CONTROL) & 0x8000) ? kInputKeyModifierControl : 0) |
+         ((GetKeyState(VK_MENU) & 0x8000) ? kInputKeyModifierAlt : 0) |
+         (((GetKeyState(VK_LWIN) | GetKeyState(VK_RWIN)) & 0x8000)
+              ? kInputKeyModifierCommand
+              : 0) |
+         ((GetKeyState(VK_CAPITAL) & 1) ? kInputKeyModifierCapsLock : 0);
+}
 
 LRESULT CALLBACK DefWndProc(HWND hWnd, uint32 message, WPARAM wParam,
                             LPARAM lParam);
@@ -244,7 +812,9 @@ void BaseWindow::Create(const ::std::string& title, uint32 x, uint32 y,
     return;
   }
 
+  auto start_time = ::std::chrono::steady_clock::now();
   input_cache_.reserve(kDefaultInputEventQueueCapacity);
+  key_modifiers_ = ReadKeyModifiers();
   instance_ = GetModuleHandle(NULL);
 
   if (!instance_) {
@@ -253,47 +823,42 @@ void BaseWindow::Create(const ::std::string& title, uint32 x, uint32 y,
 
   // Our unicode story is still in the works, and we'd still like to build
   // using the unicode character set. Thus for now we convert our ascii window
-  // title to unicode right before registering our winclass.
+  // title to unicode right before creating our window.
 
   WCHAR wszTitle[MAX_PATH];
   MultiByteToWideChar(CP_ACP, 0, title.c_str(), -1, wszTitle, MAX_PATH);
 
-  WNDCLASSEX window_class;
-  window_class.cbSize = sizeof(WNDCLASSEX);
-  window_class.style = CS_HREDRAW | CS_VREDRAW | CS_DBLCLKS | CS_OWNDC;
-  window_class.lpfnWndProc = DefWndProc;
-  window_class.cbClsExtra = 0;
-  window_class.cbWndExtra = 0;
-  window_class.hInstance = instance_;
-  window_class.hIcon = NULL;
-  window_class.hCursor = LoadCursor(NULL, IDC_ARROW);
-  window_class.hbrBackground = (HBRUSH)GetStockObject(GRAY_BRUSH);
-  window_class.lpszMenuName = NULL;
-  window_class.lpszClassName = wszTitle;
-  window_class.hIconSm = LoadIcon(NULL, IDI_APPLICATION);
-
-  if (!RegisterClassEx(&window_class)) {
+  if (!AcquireWindowClass(instance_, &creation_stats_.reused_window_class)) {
     return;
   }
 
   bool is_fullscreen = style_flags & BASE_WINDOW_STYLE_FULLSCREEN;
   bool is_hidden = style_flags & BASE_WINDOW_STYLE_WINDOW_HIDDEN;
   bool hide_cursor = style_flags & BASE_WINDOW_STYLE_CURSOR_HIDDEN;
+  is_sizable_ = style_flags & BASE_WINDOW_STYLE_SIZABLE;
+
+  DWORD window_style = BASE_WINDOW_STYLE_WINDOWED_STYLE;
+  if (is_sizable_) {
+    window_style |= BASE_WINDOW_STYLE_SIZABLE_STYLE;
+  }
+  if (is_fullscreen) {
+    window_style = BASE_WINDOW_STYLE_FULLSCREEN_STYLE;
+  }
 
   window_handle_ =
-      CreateWindowEx(0L, wszTitle, wszTitle,
-                     (is_fullscreen ? BASE_WINDOW_STYLE_FULLSCREEN_STYLE
-                                    : BASE_WINDOW_STYLE_WINDOWED_STYLE),
+      CreateWindowEx(0L, kWindowClassName, wszTitle, window_style,
                      (is_fullscreen ? 0 : x), (is_fullscreen ? 0 : y), width,
                      height, NULL, NULL, instance_, NULL);
 
   if (!window_handle_) {
-    UnregisterClass(wszTitle, instance_);
+    ReleaseWindowClass(instance_);
     return;
   }
 
   SetWindowLongPtr(window_handle_, GWLP_USERDATA, (LONG_PTR)this);
   ShowWindow(window_handle_, is_hidden ? SW_HIDE : SW_SHOW);
+  is_hidden_ = is_hidden;
+  was_visible_ = !is_hidden;
   UpdateWindow(window_handle_);
   ShowCursor(!hide_cursor);
 
@@ -302,12 +867,68 @@ void BaseWindow::Create(const ::std::string& title, uint32 x, uint32 y,
   origin_y_ = y;
   width_ = width;
   height_ = height;
+  client_width_ = width;
+  client_height_ = height;
+  windowed_width_ = width;
+  windowed_height_ = height;
   is_valid_ = true;
 
   // Windows doesn't always create windows the size that we want. Here we ensure
   // that our window will be fit to the proper size (required for pixel
   // alignment).
   Resize(width, height);
+
+  creation_stats_.window_seconds =
+      ::std::chrono::duration<float64>(::std::chrono::steady_clock::now() -
+                                       start_time)
+          .count();
+}
+
+// The reference count of the shared window class. It is guarded by a mutex, as
+// windows may be created and destroyed on different threads.
+typedef struct WindowClassRegistry {
+  ::std::mutex mutex;
+  uint32 references;
+} WindowClassRegistry;
+
+WindowClassRegistry& GetWindowClassRegistry() {
+  static WindowClassRegistry registry;
+  return registry;
+}
+
+bool AcquireWindowClass(HINSTANCE instance, bool* reused) {
+  WindowClassRegistry& registry = GetWindowClassRegistry();
+  ::std::lock_guard<::std::mutex> lock(registry.mutex);
+  *reused = registry.references > 0;
+  if (!registry.references) {
+    WNDCLASSEX window_class;
+    window_class.cbSize = sizeof(WNDCLASSEX);
+    window_class.style = CS_HREDRAW | CS_VREDRAW | CS_DBLCLKS | CS_OWNDC;
+    window_class.lpfnWndProc = DefWndProc;
+    window_class.cbClsExtra = 0;
+    window_class.cbWndExtra = 0;
+    window_class.hInstance = instance;
+    window_class.hIcon = NULL;
+    window_class.hCursor = LoadCursor(NULL, IDC_ARROW);
+    window_class.hbrBackground = (HBRUSH)GetStockObject(GRAY_BRUSH);
+    window_class.lpszMenuName = NULL;
+    window_class.lpszClassName = kWindowClassName;
+    window_class.hIconSm = LoadIcon(NULL, IDI_APPLICATION);
+
+    if (!RegisterClassEx(&window_class)) {
+      return false;
+    }
+  }
+  registry.references++;
+  return true;
+}
+
+void ReleaseWindowClass(HINSTANCE instance) {
+  WindowClassRegistry& registry = GetWindowClassRegistry();
+  ::std::lock_guard<::std::mutex> lock(registry.mutex);
+  if (registry.references && !--registry.references) {
+    UnregisterClass(kWindowClassName, instance);
+  }
 }
 
 uint32 BaseWindow::Update(::std::vector<InputEvent>* queue) {
@@ -315,6 +936,30 @@ uint32 BaseWindow::Update(::std::vector<InputEvent>* queue) {
     return -1;
   }
 
+  // Raw input can arrive many times faster than the message pump is serviced,
+  // so we drain it in bulk rather than dispatching one WM_INPUT at a time.
+  // Any reports that arrive after this point are handled by DefWndProc.
+  if (raw_mouse_enabled_ && GetRawInputTarget() == window_handle_) {
+    UINT block_size = 0;
+    GetRawInputBuffer(NULL, &block_size, sizeof(RAWINPUTHEADER));
+    if (block_size) {
+      raw_input_buffer_.resize((block_size * 64 + 7) / 8);
+      for (;;) {
+        UINT buffer_size = UINT(raw_input_buffer_.size() * sizeof(uint64));
+        PRAWINPUT raw = reinterpret_cast<PRAWINPUT>(raw_input_buffer_.data());
+        UINT count = GetRawInputBuffer(raw, &buffer_size,
+                                       sizeof(RAWINPUTHEADER));
+        if (count == 0 || count == (UINT)-1) {
+          break;
+        }
+        for (UINT i = 0; i < count; i++) {
+          ProcessRawInput(raw);
+          raw = NEXTRAWINPUTBLOCK(raw);
+        }
+      }
+    }
+  }
+
   MSG msg;
   // Windows provides us with a single message pump for each thread. This
   // queue will receive messages for all windows on the thread. We peek the
@@ -336,6 +981,21 @@ uint32 BaseWindow::Update(::std::vector<InputEvent>* queue) {
     DispatchMessage(&msg);
   }
 
+  ApplyPendingResize();
+  UpdateVisibility();
+
+  // Gamepads do not deliver messages, so we sample them once per update.
+  if (gamepad_poll_) {
+    for (uint32 i = 0; i < kMaxGamepads; i++) {
+      GamepadState state = GamepadState();
+      if (!gamepad_poll_(i, &state)) {
+        state.is_connected = false;
+      }
+      TranslateGamepadState(i, gamepad_states_[i], state, &input_cache_);
+      gamepad_states_[i] = state;
+    }
+  }
+
   if (queue) {
     // Move the input events that are cached in the window to the output queue.
     // To be extra safe we clear the input_cache_ after the move.
@@ -347,24 +1007,186 @@ uint32 BaseWindow::Update(::std::vector<InputEvent>* queue) {
 }
 
 void BaseWindow::Destroy() {
-  if (!is_valid_) {
+  // Raw input registration outlives the window, so we always release it.
+  SetRawMouseInput(false);
+
+  // A window that was closed by the user is no longer valid, but it still
+  // holds a reference to the window class.
+  if (!window_handle_) {
     return;
   }
 
-  WCHAR wszTitle[MAX_PATH] = {0};
-  MultiByteToWideChar(CP_ACP, 0, title_.c_str(), -1, wszTitle, MAX_PATH);
-
   // We call DestroyWindow here but do not check its return type. This is
   // due to the fact that this can legitimately fail in certain circumstances.
   // For example, if the window was closed via a WM_CLOSE / WM_QUIT message,
   // then the dispatch handler for this message will have already destroyed
   // the window, thus rendering our handle invalid.
   DestroyWindow(window_handle_);
-  UnregisterClass(wszTitle, instance_);
+  window_handle_ = NULL;
+  ReleaseWindowClass(instance_);
+}
+
+// Raw input registration is process wide and targets a single window, so we
+// track every window that wants raw input. It is guarded by a mutex, as
+// windows may be created and destroyed on different threads.
+typedef struct RawInputRegistry {
+  ::std::mutex mutex;
+  // Windows with raw input enabled, in the order that they enabled it.
+  ::std::vector<HWND> windows;
+  // The window that raw input is currently delivered to.
+  HWND target;
+} RawInputRegistry;
+
+RawInputRegistry& GetRawInputRegistry() {
+  static RawInputRegistry registry;
+  return registry;
+}
+
+HWND GetRawInputTarget() {
+  RawInputRegistry& registry = GetRawInputRegistry();
+  ::std::lock_guard<::std::mutex> lock(registry.mutex);
+  return registry.target;
+}
+
+// Directs raw mouse input to target, or removes the registration if target is
+// null. Returns true on success.
+bool RegisterRawMouseInput(HWND target) {
+  // We do not request RIDEV_NOLEGACY, so regular mouse messages (and thus
+  // kInputMouseMoveIndex events) continue to arrive alongside raw motion.
+  RAWINPUTDEVICE device;
+  device.usUsagePage = HID_USAGE_PAGE_GENERIC;
+  device.usUsage = HID_USAGE_GENERIC_MOUSE;
+  device.dwFlags = target ? 0 : RIDEV_REMOVE;
+  device.hwndTarget = target;
+  return !!RegisterRawInputDevices(&device, 1, sizeof(device));
+}
+
+void BaseWindow::SetRawMouseInput(bool enabled) {
+  if (enabled == raw_mouse_enabled_ || (enabled && !is_valid_)) {
+    return;
+  }
+
+  RawInputRegistry& registry = GetRawInputRegistry();
+  ::std::lock_guard<::std::mutex> lock(registry.mutex);
+  auto& windows = registry.windows;
+
+  if (enabled) {
+    if (RegisterRawMouseInput(window_handle_)) {
+      windows.push_back(window_handle_);
+      registry.target = window_handle_;
+      raw_mouse_enabled_ = true;
+    }
+    return;
+  }
+
+  windows.erase(::std::remove(windows.begin(), windows.end(), window_handle_),
+                windows.end());
+  raw_mouse_enabled_ = false;
+
+  // Removing the registration would silence every other window that enabled
+  // raw input, so we hand it to the most recent of them instead.
+  if (registry.target == window_handle_) {
+    registry.target = windows.empty() ? NULL : windows.back();
+    RegisterRawMouseInput(registry.target);
+  }
+}
+
+void BaseWindow::ProcessRawInput(const RAWINPUT* raw) {
+  // Absolute reports come from tablets and remote desktop sessions, which
+  // already produce accurate WM_MOUSEMOVE messages.
+  if (raw->header.dwType != RIM_TYPEMOUSE ||
+      (raw->data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE)) {
+    return;
+  }
+  if (!raw->data.mouse.lLastX && !raw->data.mouse.lLastY) {
+    return;
+  }
+
+  InputEvent event;
+  event.input_type = InputTypeTarget;
+  event.switch_index = kInputMouseRawMotionIndex;
+  event.switch_extension = 0;
+  event.target_x = (float32)raw->data.mouse.lLastX;
+  event.target_y = (float32)raw->data.mouse.lLastY;
+  event.is_on = false;
+  input_cache_.push_back(event);
+}
+
+void BaseWindow::PresentPixels() {
+  if (!is_valid_ || pixels_.empty()) {
+    return;
+  }
+
+  BITMAPINFO bitmap_info;
+  memset(&bitmap_info, 0, sizeof(bitmap_info));
+  bitmap_info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+  bitmap_info.bmiHeader.biWidth = pixel_stride_;
+  // A negative height indicates a top-down bitmap, matching our row order.
+  bitmap_info.bmiHeader.biHeight = -(LONG)pixel_height_;
+  bitmap_info.bmiHeader.biPlanes = 1;
+  bitmap_info.bmiHeader.biBitCount = 32;
+  bitmap_info.bmiHeader.biCompression = BI_RGB;
+
+  HDC device_context = GetDC(window_handle_);
+  SetDIBitsToDevice(device_context, 0, 0, pixel_width_, pixel_height_, 0, 0, 0,
+                    pixel_height_, pixels_.data(), &bitmap_info,
+                    DIB_RGB_COLORS);
+  ReleaseDC(window_handle_, device_context);
 }
 
 void BaseWindow::SetVisible(bool visible) {
   ShowWindow(window_handle_, visible ? SW_SHOW : SW_HIDE);
+  is_hidden_ = !visible;
+}
+
+void BaseWindow::ApplyPendingResize() {
+  if (!client_width_ || !client_height_ ||
+      (client_width_ == width_ && client_height_ == height_)) {
+    return;
+  }
+
+  width_ = client_width_;
+  height_ = client_height_;
+
+  InputEvent event;
+  event.input_type = InputTypeTarget;
+  event.switch_index = kInputWindowResizeIndex;
+  event.switch_extension = 0;
+  event.target_x = (float32)width_;
+  event.target_y = (float32)height_;
+  event.is_on = false;
+  input_cache_.push_back(event);
+}
+
+void BaseWindow::UpdateVisibility() {
+  // Windows does not notify us when we are covered, so we poll. A cloaked
+  // window is composited but not shown (e.g. it is on another virtual
+  // desktop). Without composition, a covered window has an empty clip box.
+  if (!is_minimized_ && !is_hidden_) {
+    DWORD cloaked = 0;
+    if (!SUCCEEDED(DwmGetWindowAttribute(window_handle_, DWMWA_CLOAKED,
+                                         &cloaked, sizeof(cloaked)))) {
+      cloaked = 0;
+    }
+    RECT clip_box;
+    HDC device_context = GetDC(window_handle_);
+    int32 region = GetClipBox(device_context, &clip_box);
+    ReleaseDC(window_handle_, device_context);
+    is_occluded_ = cloaked || region == NULLREGION;
+  }
+
+  bool is_visible = IsVisible();
+  if (is_visible != was_visible_) {
+    InputEvent event;
+    event.input_type = InputTypeSwitch;
+    event.switch_index = kInputWindowVisibleIndex;
+    event.switch_extension = 0;
+    event.target_x = 0;
+    event.target_y = 0;
+    event.is_on = is_visible;
+    input_cache_.push_back(event);
+    was_visible_ = is_visible;
+  }
 }
 
 void BaseWindow::SetCursorVisible(bool visible) { ShowCursor(visible); }
@@ -377,8 +1199,17 @@ void BaseWindow::SetFullscreen(bool fullscreen) {
   uint32 old_style = GetWindowLong(window_handle_, GWL_STYLE);
 
   if (fullscreen) {
+    // Remember the windowed size, as the WM_SIZE that follows will replace
+    // the client size with the size of the screen. A window that is
+    // already fullscreen keeps the size it had before.
+    if (!(old_style & WS_POPUP)) {
+      windowed_width_ = client_width_;
+      windowed_height_ = client_height_;
+    }
+
     old_style &= ~WS_CAPTION;
     old_style &= ~BASE_WINDOW_STYLE_WINDOWED_STYLE;
+    old_style &= ~BASE_WINDOW_STYLE_SIZABLE_STYLE;
     old_style |= BASE_WINDOW_STYLE_FULLSCREEN_STYLE;
 
     SetWindowLongPtr(window_handle_, GWL_STYLE, old_style);
@@ -389,11 +1220,14 @@ void BaseWindow::SetFullscreen(bool fullscreen) {
     old_style &= ~BASE_WINDOW_STYLE_FULLSCREEN_STYLE;
     old_style |= BASE_WINDOW_STYLE_WINDOWED_STYLE;
     old_style |= WS_CAPTION;
+    if (is_sizable_) {
+      old_style |= BASE_WINDOW_STYLE_SIZABLE_STYLE;
+    }
 
     SetWindowLongPtr(window_handle_, GWL_STYLE, old_style);
     SetWindowPos(window_handle_, HWND_TOP, origin_x_, origin_y_, 0, 0,
                  SWP_NOSIZE | SWP_FRAMECHANGED);
-    Resize(width_, height_);
+    Resize(windowed_width_, windowed_height_);
   }
 }
 
@@ -415,22 +1249,26 @@ void BaseWindow::Resize(uint32 width, uint32 height) {
     return;
   }
 
+  RECT client_rect = {0};
   RECT window_rect = {0};
 
   // We wish to create a window with a client area equal to that of
-  // width x height. Unfortunately, CreateWindowEx will consume some of the
-  // requested space with the non-client area. Thus, we calculate how much it
-  // consumed, and then resize up to guarantee a client area that matches our
-  // requested dimensions.
-
-  if (GetClientRect(window_handle_, &window_rect)) {
-    uint32 client_width = (window_rect.right - window_rect.left);
-    uint32 client_height = (window_rect.bottom - window_rect.top);
-    uint32 nc_width = (client_width < width_) ? width_ - client_width : 0;
-    uint32 nc_height = (client_height < height_) ? height_ - client_height : 0;
+  // width x height. Unfortunately, some of the window's area is consumed by
+  // the non-client area. Thus, we calculate how much is consumed, and then
+  // size the window to guarantee a client area that matches our requested
+  // dimensions.
+
+  if (GetClientRect(window_handle_, &client_rect) &&
+      GetWindowRect(window_handle_, &window_rect)) {
+    uint32 nc_width = (window_rect.right - window_rect.left) -
+                      (client_rect.right - client_rect.left);
+    uint32 nc_height = (window_rect.bottom - window_rect.top) -
+                       (client_rect.bottom - client_rect.top);
 
     width_ = width;
     height_ = height;
+    client_width_ = width;
+    client_height_ = height;
     SetWindowPos(window_handle_, HWND_TOP, 0, 0, width_ + nc_width,
                  height_ + nc_height, SWP_NOMOVE | SWP_FRAMECHANGED);
   }
@@ -439,7 +1277,6 @@ void BaseWindow::Resize(uint32 width, uint32 height) {
 LRESULT CALLBACK DefWndProc(HWND hWnd, UINT message, WPARAM wParam,
                             LPARAM lParam) {
   InputEvent event;
-  uint32 shifted_hold = 0;
 
   // We pull out the CVWindow object, as well as the input queue. Note that
   // upon error, we overload the return value to be an engine error value.
@@ -473,12 +1310,22 @@ LRESULT CALLBACK DefWndProc(HWND hWnd, UINT message, WPARAM wParam,
       // Convert our mouse coordinates into normalized device coordinates,
       // which range from -1...1 on each axis. Note that due to aspect ratio,
       // one axis may span a greater number of pixels than the other, though
-      // their normalized device span is the same (2.0).
-      event.target_x = GET_UNIT_X_VALUE(LOWORD(lParam), window->GetWidth());
-      event.target_y = GET_UNIT_Y_VALUE(HIWORD(lParam), window->GetHeight());
+      // their normalized device span is the same (2.0). We normalize against
+      // the client size as of this message, as a resize may still be pending.
+      event.target_x = GET_UNIT_X_VALUE(LOWORD(lParam), window->client_width_);
+      event.target_y = GET_UNIT_Y_VALUE(HIWORD(lParam), window->client_height_);
       window->input_cache_.push_back(event);
     } break;
 
+    case WM_INPUT: {
+      RAWINPUT raw;
+      UINT size = sizeof(raw);
+      if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, &raw, &size,
+                          sizeof(RAWINPUTHEADER)) != (UINT)-1) {
+        window->ProcessRawInput(&raw);
+      }
+    } break;
+
     case WM_MOUSEWHEEL: {
       // Windows insists on providing a delta value for the mouse wheel. This
       // does not align with our input model, so we instead track the absolute
@@ -498,8 +1345,8 @@ LRESULT CALLBACK DefWndProc(HWND hWnd, UINT message, WPARAM wParam,
       event.input_type = InputTypeSwitch;
       event.is_on = true;
       event.switch_index = kInputMouseLeftButtonIndex;
-      event.target_x = GET_UNIT_X_VALUE(LOWORD(lParam), window->GetWidth());
-      event.target_y = GET_UNIT_Y_VALUE(HIWORD(lParam), window->GetHeight());
+      event.target_x = GET_UNIT_X_VALUE(LOWORD(lParam), window->client_width_);
+      event.target_y = GET_UNIT_Y_VALUE(HIWORD(lParam), window->client_height_);
       window->input_cache_.push_back(event);
     } break;
 
@@ -507,8 +1354,8 @@ LRESULT CALLBACK DefWndProc(HWND hWnd, UINT message, WPARAM wParam,
       event.input_type = InputTypeSwitch;
       event.is_on = false;
       event.switch_index = kInputMouseLeftButtonIndex;
-      event.target_x = GET_UNIT_X_VALUE(LOWORD(lParam), window->GetWidth());
-      event.target_y = GET_UNIT_Y_VALUE(HIWORD(lParam), window->GetHeight());
+      event.target_x = GET_UNIT_X_VALUE(LOWORD(lParam), window->client_width_);
+      event.target_y = GET_UNIT_Y_VALUE(HIWORD(lParam), window->client_height_);
       window->input_cache_.push_back(event);
     } break;
 
@@ -516,8 +1363,8 @@ LRESULT CALLBACK DefWndProc(HWND hWnd, UINT message, WPARAM wParam,
       event.input_type = InputTypeSwitch;
       event.is_on = true;
       event.switch_index = kInputMouseRightButtonIndex;
-      event.target_x = GET_UNIT_X_VALUE(LOWORD(lParam), window->GetWidth());
-      event.target_y = GET_UNIT_Y_VALUE(HIWORD(lParam), window->GetHeight());
+      event.target_x = GET_UNIT_X_VALUE(LOWORD(lParam), window->client_width_);
+      event.target_y = GET_UNIT_Y_VALUE(HIWORD(lParam), window->client_height_);
       window->input_cache_.push_back(event);
     } break;
 
@@ -525,84 +1372,57 @@ LRESULT CALLBACK DefWndProc(HWND hWnd, UINT message, WPARAM wParam,
       event.input_type = InputTypeSwitch;
       event.is_on = false;
       event.switch_index = kInputMouseRightButtonIndex;
-      event.target_x = GET_UNIT_X_VALUE(LOWORD(lParam), window->GetWidth());
-      event.target_y = GET_UNIT_Y_VALUE(HIWORD(lParam), window->GetHeight());
+      event.target_x = GET_UNIT_X_VALUE(LOWORD(lParam), window->client_width_);
+      event.target_y = GET_UNIT_Y_VALUE(HIWORD(lParam), window->client_height_);
       window->input_cache_.push_back(event);
     } break;
 
-    case WM_KEYDOWN: {
+    case WM_KEYDOWN:
+    case WM_SYSKEYDOWN: {
       // We do not send repeating strokes -- if the key was previously
       // down, then we've already handled this and can ignore it.
       if (lParam & 0x40000000) {
         break;
       }
 
-      event.input_type = InputTypeSwitch;
-      event.is_on = true;
-      event.switch_index = wParam;
-      event.switch_extension = ConvertScan((uint32)wParam, shifted_hold);
-
-      if (16 == wParam) {
-        shifted_hold = 1;
-      }
-
+      TranslateKey(kVirtualKeyTable, (uint32)wParam, true,
+                   &window->key_modifiers_, &event);
       window->input_cache_.push_back(event);
     } break;
 
-    case WM_KEYUP: {
-      if (16 == wParam) {
-        shifted_hold = 0;
-      }
-
-      event.input_type = InputTypeSwitch;
-      event.is_on = false;
-      event.switch_index = wParam;
-      event.switch_extension = ConvertScan((uint32)wParam, shifted_hold);
-
+    case WM_KEYUP:
+    case WM_SYSKEYUP: {
+      TranslateKey(kVirtualKeyTable, (uint32)wParam, false,
+                   &window->key_modifiers_, &event);
       window->input_cache_.push_back(event);
     } break;
 
-    case WM_SYSKEYDOWN: {
-      if ((lParam & 0xFFFF) > 1) {
-        break;
+    case WM_SIZE: {
+      window->is_minimized_ = (wParam == SIZE_MINIMIZED);
+      // Only the latest size is kept. It is applied by the next Update, so
+      // that resizing does not reallocate once per mouse move.
+      if (wParam != SIZE_MINIMIZED && LOWORD(lParam) && HIWORD(lParam)) {
+        window->client_width_ = LOWORD(lParam);
+        window->client_height_ = HIWORD(lParam);
       }
+    } break;
 
-      event.input_type = InputTypeSwitch;
-      event.is_on = true;
-      event.switch_extension = 0;
-
-      switch (wParam) {
-        case VK_CONTROL:
-          event.switch_index = kInputKeyControlIndex;
-          break;
-        case VK_MENU:
-          event.switch_index = kInputKeyAltIndex;
-          break;
-        case VK_SHIFT:
-          event.switch_index = kInputKeyShiftIndex;
-          break;
-      };
-
-      window->input_cache_.push_back(event);
+    case WM_SHOWWINDOW: {
+      window->is_hidden_ = !wParam;
     } break;
 
-    case WM_SYSKEYUP: {
+    case WM_SETFOCUS:
+    case WM_KILLFOCUS: {
+      // Modifiers may have changed while another window had focus.
+      window->key_modifiers_ = ReadKeyModifiers();
+      window->is_focused_ = (message == WM_SETFOCUS);
+
       event.input_type = InputTypeSwitch;
-      event.is_on = false;
+      event.switch_index = kInputWindowFocusIndex;
       event.switch_extension = 0;
-
-      switch (wParam) {
-        case VK_CONTROL:
-          event.switch_index = kInputKeyControlIndex;
-          break;
-        case VK_MENU:
-          event.switch_index = kInputKeyAltIndex;
-          break;
-        case VK_SHIFT:
-          event.switch_index = kInputKeyShiftIndex;
-          break;
-      };
-
+      event.target_x = 0;
+      event.target_y = 0;
+      event.is_on = window->is_focused_;
       window->input_cache_.push_back(event);
     } break;
   }
@@ -610,62 +1430,70 @@ LRESULT CALLBACK DefWndProc(HWND hWnd, UINT message, WPARAM wParam,
   return DefWindowProc(hWnd, message, wParam, lParam);
 }
 
-uint32 ConvertScan(uint32 scancode, uint32 shift) {
-  if (scancode <= 32) {
-    return scancode;
-  } else if (scancode >= 65 && scancode < 91) {
-    if (shift) return scancode;
-    return scancode + 32;
-  }
-
-  switch (scancode) {
-    case '1':
-      return (!shift) ? scancode : '!';
-    case '2':
-      return (!shift) ? scancode : '@';
-    case '3':
-      return (!shift) ? scancode : '#';
-    case '4':
-      return (!shift) ? scancode : '$';
-    case '5':
-      return (!shift) ? scancode : '%';
-    case '6':
-      return (!shift) ? scancode : '^';
-    case '7':
-      return (!shift) ? scancode : '&';
-    case '8':
-      return (!shift) ? scancode : '*';
-    case '9':
-      return (!shift) ? scancode : '(';
-    case '0':
-      return (!shift) ? scancode : ')';
-    case '`':
-      return (!shift) ? scancode : '~';
-    case '.':
-      return (!shift) ? scancode : '>';
-    case 186:
-      return (!shift) ? ';' : ':';
-    case 187:
-      return (!shift) ? '=' : '+';
-    case 188:
-      return (!shift) ? ',' : '<';
-    case 189:
-      return (!shift) ? '-' : '_';
-    case 190:
-      return (!shift) ? '.' : '>';
-    case 191:
-      return (!shift) ? '/' : '?';
-    case 219:
-      return (!shift) ? '[' : '{';
-    case 220:
-      return (!shift) ? '\\' : '|';
-    case 221:
-      return (!shift) ? ']' : '}';
-    case 222:
-      return (!shift) ? '\'' : '\"';
-  };
+// Scales a raw stick position into -1...1, removing a radial dead zone so that
+// a resting stick reports exactly zero.
+void ApplyStickDeadZone(int16 raw_x, int16 raw_y, int16 dead_zone,
+                        float32* x, float32* y) {
+  float32 fx = ::std::max(-1.0f, raw_x / 32767.0f);
+  float32 fy = ::std::max(-1.0f, raw_y / 32767.0f);
+  float32 magnitude = sqrtf(fx * fx + fy * fy);
+  float32 threshold = dead_zone / 32767.0f;
+  if (magnitude <= threshold) {
+    *x = *y = 0;
+    return;
+  }
+  float32 scale =
+      ::std::min(1.0f, (magnitude - threshold) / (1.0f - threshold)) /
+      magnitude;
+  *x = fx * scale;
+  *y = fy * scale;
+}
+
+bool PollXInputGamepad(uint32 device, GamepadState* state) {
+  typedef DWORD(WINAPI * XInputGetStateFunction)(DWORD, XINPUT_STATE*);
+  static XInputGetStateFunction get_state = []() {
+    const char* libraries[] = {"xinput1_4.dll", "xinput1_3.dll",
+                               "xinput9_1_0.dll"};
+    for (const char* library : libraries) {
+      if (HMODULE module = LoadLibraryA(library)) {
+        return (XInputGetStateFunction)GetProcAddress(module, "XInputGetState");
+      }
+    }
+    return (XInputGetStateFunction) nullptr;
+  }();
+
+  // Querying an empty slot is expensive, so absent devices are only
+  // rechecked periodically. The 64 bit tick count does not wrap, so a plain
+  // comparison against the deadline is safe at any uptime.
+  const ULONGLONG kReconnectInterval = 1000;
+  static ULONGLONG next_check[XUSER_MAX_COUNT] = {0};
+
+  if (!get_state || device >= XUSER_MAX_COUNT ||
+      GetTickCount64() < next_check[device]) {
+    return false;
+  }
+
+  XINPUT_STATE xinput_state;
+  if (get_state(device, &xinput_state) != ERROR_SUCCESS) {
+    next_check[device] = GetTickCount64() + kReconnectInterval;
+    return false;
+  }
 
-  return scancode;
+  const int32 kTriggerDeadZone = XINPUT_GAMEPAD_TRIGGER_THRESHOLD;
+  const XINPUT_GAMEPAD& pad = xinput_state.Gamepad;
+  state->is_connected = true;
+  state->buttons = pad.wButtons;
+  ApplyStickDeadZone(pad.sThumbLX, pad.sThumbLY,
+                     XINPUT_GAMEPAD_LEFT_THUMB_DEADZONE, &state->left_x,
+                     &state->left_y);
+  ApplyStickDeadZone(pad.sThumbRX, pad.sThumbRY,
+                     XINPUT_GAMEPAD_RIGHT_THUMB_DEADZONE, &state->right_x,
+                     &state->right_y);
+  state->left_trigger = ::std::max(0, pad.bLeftTrigger - kTriggerDeadZone) /
+                        float32(255 - kTriggerDeadZone);
+  state->right_trigger = ::std::max(0, pad.bRightTrigger - kTriggerDeadZone) /
+                         float32(255 - kTriggerDeadZone);
+  return true;
 }
 
 }  // namespace base